@@ -0,0 +1,470 @@
+/** Micro-benchmarks for the core kernels.
+ *
+ * Usage: gitlite_bench [--filter=SUBSTR] [--min-time=SEC] [--out=FILE]
+ *                      [--baseline=FILE] [--threshold=PERCENT]
+ *
+ * Each benchmark is calibrated to run for at least --min-time seconds, then
+ * measured five times; the median time per operation is reported.  Results are
+ * written as JSON to --out (default: stdout).  With --baseline, results are
+ * compared against an earlier JSON file and the program exits with status 1 if
+ * any benchmark got slower by more than --threshold percent (default 10).
+ *
+ * Build with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+ */
+#include "../include/ChangedPaths.h"
+#include "../include/Manifest.h"
+#include "../include/ObjectStore.h"
+#include "../include/RefStore.h"
+#include "../include/SomeObj.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** Gives the benchmarks access to SomeObj's private helpers. */
+class SomeObjBench {
+public:
+    static Manifest getFilesInCommit(SomeObj &repo, const std::string &commitId) {
+        return repo.getFilesInCommit(commitId);
+    }
+    static std::string findSplitPoint(SomeObj &repo, const std::string &a, const std::string &b) {
+        return repo.findSplitPoint(a, b);
+    }
+};
+
+namespace {
+
+struct Result {
+    std::string name;
+    long long iterations;
+    double nsPerOp;
+    double bytesPerOp;
+};
+
+std::vector<Result> results;
+std::string filter;
+double minTime = 0.2;
+
+/** Keeps the optimizer from discarding a benchmark's result. */
+template <typename T>
+void doNotOptimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+void measure(const std::string &name, const std::function<void()> &op, double bytesPerOp = 0) {
+    if (!filter.empty() && name.find(filter) == std::string::npos) {
+        return;
+    }
+    using Clock = std::chrono::steady_clock;
+    auto timeRun = [&op](long long iterations) {
+        auto start = Clock::now();
+        for (long long i = 0; i < iterations; ++i) {
+            op();
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // Calibrate: grow the iteration count until one run takes minTime
+    long long iterations = 1;
+    double elapsed = timeRun(iterations);
+    while (elapsed < minTime && iterations < (1LL << 40)) {
+        double scale = elapsed > 0 ? minTime / elapsed * 1.2 : 10;
+        iterations = std::max(iterations + 1, static_cast<long long>(iterations * std::min(scale, 10.0)));
+        elapsed = timeRun(iterations);
+    }
+
+    std::vector<double> samples;
+    for (int rep = 0; rep < 5; ++rep) {
+        samples.push_back(timeRun(iterations) * 1e9 / iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+    results.push_back({name, iterations, samples[samples.size() / 2], bytesPerOp});
+    std::cerr << name << ": " << samples[samples.size() / 2] << " ns/op" << std::endl;
+}
+
+/** A scratch directory that is removed again on destruction. */
+class ScratchDir {
+public:
+    ScratchDir() {
+        char pattern[] = "/tmp/gitlite-bench-XXXXXX";
+        path = mkdtemp(pattern);
+    }
+    ~ScratchDir() {
+        std::string command = "rm -rf " + path;
+        system(command.c_str());
+    }
+    std::string path;
+};
+
+/** Runs the enclosing scope with the current directory set to DIR. */
+class ChangeDir {
+public:
+    explicit ChangeDir(const std::string &dir) {
+        char buffer[4096];
+        previous = getcwd(buffer, sizeof(buffer)) ? buffer : ".";
+        if (chdir(dir.c_str()) != 0) {
+            throw std::runtime_error("cannot enter " + dir);
+        }
+    }
+    ~ChangeDir() {
+        if (chdir(previous.c_str()) != 0) {
+            std::cerr << "cannot return to " << previous << std::endl;
+        }
+    }
+    std::string previous;
+};
+
+std::string makeBytes(size_t size) {
+    std::string data(size, '\0');
+    uint32_t state = 12345;
+    for (auto &c : data) {
+        state = state * 1103515245 + 12345;
+        c = static_cast<char>('a' + (state >> 16) % 26);
+    }
+    return data;
+}
+
+/** Returns SIZE bytes of source-like text: lines drawn from a small
+ *  vocabulary, so that it compresses about as well as typical files. */
+std::string makeText(size_t size) {
+    static const char *words[] = {"int", "return", "std::string", "const", "auto", "if", "for",
+                                  "value", "content", "id", "(", ")", "{", "}", ";", "=", "0", "1"};
+    std::string text;
+    uint32_t state = 12345;
+    while (text.size() < size) {
+        state = state * 1103515245 + 12345;
+        int count = 3 + (state >> 16) % 8;
+        text += std::string(4 * ((state >> 8) % 3), ' ');
+        for (int i = 0; i < count; ++i) {
+            state = state * 1103515245 + 12345;
+            text += words[(state >> 16) % (sizeof(words) / sizeof(words[0]))];
+            text += ' ';
+        }
+        text += '\n';
+    }
+    text.resize(size);
+    return text;
+}
+
+/** Writes a commit object in the current repository and returns its ID. */
+std::string writeCommit(const std::string &parents, long long timestamp, const std::string &files) {
+    std::string content = "parent " + parents + "\n";
+    content += "timestamp " + std::to_string(timestamp) + "\n";
+    content += "message synthetic\n";
+    content += "files " + files + "\n";
+    std::string commitId = Utils::sha1(content);
+    ObjectStore().write(commitId, content);
+    return commitId;
+}
+
+void benchSha() {
+    for (size_t size : {64, 4096, 1 << 20}) {
+        std::string data = makeBytes(size);
+        measure("sha1/" + std::to_string(size), [&] { doNotOptimize(SHA1::sha.sha(data)); }, size);
+    }
+}
+
+void benchChunking() {
+    std::string data = makeBytes(16 << 20);
+    measure("chunkBoundaries/16MiB", [&] { doNotOptimize(ObjectStore::chunkBoundaries(data)); }, data.size());
+}
+
+/** Object write and read throughput at compression levels 0 (stored as is,
+ *  the uncompressed path), 1 (the default) and 9. */
+void benchObjectCompression() {
+    ScratchDir scratch;
+    std::string path = Utils::join(scratch.path, "object");
+    std::string data = makeText(1 << 20);
+    for (int level : {0, 1, 9}) {
+        std::string suffix = "/level" + std::to_string(level);
+        measure("objectWrite" + suffix,
+                [&] { Utils::writeContents(path, ObjectStore::encode(data, level)); }, data.size());
+        Utils::writeContents(path, ObjectStore::encode(data, level));
+        measure("objectRead" + suffix, [&] {
+            std::string content;
+            doNotOptimize(ObjectStore::decode(Utils::readContentsAsString(path), content));
+            doNotOptimize(content);
+        }, data.size());
+    }
+}
+
+void benchGetFilesInCommit() {
+    ScratchDir scratch;
+    ChangeDir cwd(scratch.path);
+    Utils::createDirectories(".gitlite/objects");
+    SomeObj repo;
+
+    for (int entries : {10, 1000, 100000}) {
+        std::string files;
+        for (int i = 0; i < entries; ++i) {
+            std::string name = "dir" + std::to_string(i % 100) + "_file" + std::to_string(i) + ".txt";
+            files += name + ":" + Utils::sha1(name) + ";";
+        }
+        std::string commitId = writeCommit("", entries, files);
+        // Clear the manifest cache so every iteration parses the commit
+        measure("getFilesInCommit/" + std::to_string(entries), [&] {
+            repo.clearCaches();
+            doNotOptimize(SomeObjBench::getFilesInCommit(repo, commitId));
+        });
+    }
+}
+
+/** Diffs two 100k-entry manifests that differ in 1% of their files. */
+void benchManifestJoin() {
+    std::vector<std::pair<std::string, std::string>> ours, theirs;
+    for (int i = 0; i < 100000; ++i) {
+        std::string name = "dir" + std::to_string(i % 100) + "/file" + std::to_string(i) + ".txt";
+        ours.emplace_back(name, Utils::sha1(name));
+        theirs.emplace_back(name, i % 100 == 0 ? Utils::sha1(name + "'") : ours.back().second);
+    }
+    // Sorted like a commit's files line, so entries are laid out in name order
+    std::sort(ours.begin(), ours.end());
+    std::sort(theirs.begin(), theirs.end());
+    Manifest a = Manifest::fromEntries(ours);
+    Manifest b = Manifest::fromEntries(theirs);
+    measure("manifestJoin/100000", [&] {
+        size_t changed = 0;
+        Manifest::Join join({&a, &b});
+        while (join.next()) {
+            changed += join.blobId(0) != join.blobId(1);
+        }
+        doNotOptimize(changed);
+    });
+}
+
+void benchPlainFilenamesIn() {
+    for (int count : {1000, 20000}) {
+        ScratchDir scratch;
+        for (int i = 0; i < count; ++i) {
+            Utils::writeContents(Utils::join(scratch.path, "file" + std::to_string(i)), "");
+        }
+        measure("plainFilenamesIn/" + std::to_string(count),
+                [&] { doNotOptimize(Utils::plainFilenamesIn(scratch.path)); });
+    }
+}
+
+/** Times listing and looking up 20k branches, stored loose and then packed. */
+void benchRefs() {
+    const int count = 20000;
+    ScratchDir scratch;
+    RefStore refs(scratch.path);
+    std::string id(40, 'a');
+    for (int i = 0; i < count; ++i) {
+        Utils::writeContents(Utils::join(scratch.path, RefStore::branchRef("branch" + std::to_string(i))), id);
+    }
+    std::string probe = RefStore::branchRef("branch" + std::to_string(count / 3));
+    for (const char *layout : {"loose", "packed"}) {
+        if (std::string(layout) == "packed") {
+            refs.pack();
+        }
+        measure(std::string("refBranches/") + layout, [&] { doNotOptimize(refs.branches()); });
+        measure(std::string("refRead/") + layout, [&] { doNotOptimize(refs.read(probe)); });
+    }
+}
+
+void benchReadWriteContents() {
+    ScratchDir scratch;
+    std::string path = Utils::join(scratch.path, "data");
+    for (size_t size : {4096, 1 << 20}) {
+        std::string data = makeBytes(size);
+        measure("writeContents/" + std::to_string(size), [&] { Utils::writeContents(path, data); }, size);
+        measure("readContents/" + std::to_string(size),
+                [&] { doNotOptimize(Utils::readContents(path)); }, size);
+    }
+}
+
+/**
+ * Builds a DAG with a trunk of DEPTH commits and a side branch that forks at
+ * the middle, merging trunk back in every MERGEEVERY commits, then times the
+ * merge base search between the two tips.
+ */
+void benchFindSplitPoint() {
+    ScratchDir scratch;
+    ChangeDir cwd(scratch.path);
+    Utils::createDirectories(".gitlite/objects");
+    SomeObj repo;
+
+    for (int depth : {100, 2000}) {
+        const int mergeEvery = 10;
+        std::vector<std::string> trunk = {writeCommit("", 0, "")};
+        for (int i = 1; i < depth; ++i) {
+            trunk.push_back(writeCommit(trunk.back(), i, ""));
+        }
+        std::string side = trunk[depth / 2];
+        for (int i = depth / 2 + 1; i < depth; ++i) {
+            std::string parents = side;
+            if (i % mergeEvery == 0) {
+                parents += " " + trunk[i - mergeEvery / 2];
+            }
+            side = writeCommit(parents, depth + i, "side");
+        }
+        std::string tip = trunk.back();
+        measure("findSplitPoint/" + std::to_string(depth), [&] {
+            repo.clearCaches();
+            doNotOptimize(SomeObjBench::findSplitPoint(repo, tip, side));
+        });
+    }
+}
+
+/**
+ * Builds a history of DEPTH commits in which a 400-line file is edited in
+ * every fourth commit (a few lines changed, one appended) and another file
+ * in the rest, then times blaming the hot file from the tip.
+ */
+void benchBlame() {
+    ScratchDir scratch;
+    ChangeDir cwd(scratch.path);
+    Utils::createDirectories(".gitlite/objects");
+    Utils::createDirectories(".gitlite/refs/heads");
+    std::ostringstream sink;
+    SomeObj repo(sink);
+
+    for (int depth : {100, 1000}) {
+        std::vector<std::string> lines;
+        for (int i = 0; i < 400; ++i) {
+            lines.push_back("line " + std::to_string(i) + " " + makeText(40).substr(0, 30));
+        }
+        std::string otherBlob;
+        std::string parent;
+        Manifest parentFiles;
+        uint32_t state = 12345;
+        for (int i = 0; i < depth; ++i) {
+            if (i % 4 == 0) {
+                for (int edit = 0; edit < 3; ++edit) {
+                    state = state * 1103515245 + 12345;
+                    lines[(state >> 8) % lines.size()] = "edit " + std::to_string(i) + "." + std::to_string(edit);
+                }
+                lines.push_back("appended " + std::to_string(i));
+            }
+            std::string hot;
+            for (const auto &line : lines) {
+                hot += line + "\n";
+            }
+            std::string other = "other " + std::to_string(i) + "\n";
+            std::string hotBlob = Utils::sha1(hot);
+            otherBlob = Utils::sha1(other);
+            ObjectStore().writeBlob(hotBlob, hot);
+            ObjectStore().writeBlob(otherBlob, other);
+            std::string files = "hot.txt:" + hotBlob + ";other.txt:" + otherBlob + ";";
+            parent = writeCommit(parent, i, files);
+            std::string content = ObjectStore().read(parent);
+            ChangedPaths::append(".gitlite/objects", parent, content, parentFiles);
+            parentFiles = Manifest::fromCommit(content);
+        }
+        RefStore refs;
+        refs.write(RefStore::branchRef("master"), parent);
+        refs.write("HEAD", "ref: " + RefStore::branchRef("master"));
+
+        measure("blame/" + std::to_string(depth), [&] {
+            repo.clearCaches();
+            sink.str("");
+            repo.blame("hot.txt");
+        });
+    }
+}
+
+std::string toJson() {
+    std::ostringstream out;
+#ifdef NDEBUG
+    const char *buildType = "optimized";
+#else
+    const char *buildType = "debug";
+#endif
+    out << "{\n  \"build\": \"" << buildType << "\",\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+            << ", \"ns_per_op\": " << std::fixed << std::setprecision(2) << r.nsPerOp;
+        if (r.bytesPerOp > 0) {
+            out << ", \"mb_per_s\": " << r.bytesPerOp / r.nsPerOp * 1e3;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+/** Reads name -> ns_per_op from a JSON file written by toJson(). */
+std::map<std::string, double> readBaseline(const std::string &path) {
+    std::map<std::string, double> baseline;
+    std::string json = Utils::readContentsAsString(path);
+    std::regex entry("\"name\":\\s*\"([^\"]+)\"[^}]*\"ns_per_op\":\\s*([0-9.eE+-]+)");
+    for (std::sregex_iterator it(json.begin(), json.end(), entry), end; it != end; ++it) {
+        baseline[(*it)[1]] = std::stod((*it)[2]);
+    }
+    return baseline;
+}
+
+/** Prints a comparison table and returns the number of regressions beyond THRESHOLD percent. */
+int compareWithBaseline(const std::map<std::string, double> &baseline, double threshold) {
+    int regressions = 0;
+    for (const auto &r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end()) {
+            std::cerr << std::left << std::setw(28) << r.name << "   (new)" << std::endl;
+            continue;
+        }
+        double change = (r.nsPerOp - it->second) / it->second * 100;
+        bool regressed = change > threshold;
+        regressions += regressed;
+        std::cerr << std::left << std::setw(28) << r.name << std::right << std::setw(8) << std::fixed
+                  << std::setprecision(1) << change << "%" << (regressed ? "   REGRESSION" : "") << std::endl;
+    }
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    std::string outPath, baselinePath;
+    double threshold = 10;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&arg](const std::string &prefix) { return arg.substr(prefix.size()); };
+        if (arg.rfind("--filter=", 0) == 0) {
+            filter = value("--filter=");
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            minTime = std::stod(value("--min-time="));
+        } else if (arg.rfind("--out=", 0) == 0) {
+            outPath = value("--out=");
+        } else if (arg.rfind("--baseline=", 0) == 0) {
+            baselinePath = value("--baseline=");
+        } else if (arg.rfind("--threshold=", 0) == 0) {
+            threshold = std::stod(value("--threshold="));
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    benchSha();
+    benchChunking();
+    benchObjectCompression();
+    benchGetFilesInCommit();
+    benchManifestJoin();
+    benchPlainFilenamesIn();
+    benchRefs();
+    benchReadWriteContents();
+    benchFindSplitPoint();
+    benchBlame();
+
+    std::string json = toJson();
+    if (outPath.empty()) {
+        std::cout << json;
+    } else {
+        Utils::writeContents(outPath, json);
+    }
+
+    if (!baselinePath.empty()) {
+        return compareWithBaseline(readBaseline(baselinePath), threshold) > 0 ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef CHANGEDPATHS_H
+#define CHANGEDPATHS_H
+
+#include "Manifest.h"
+#include "ObjectId.h"
+#include "ObjectStore.h"
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Per-commit Bloom filters of changed paths, for path-limited history.
+ *
+ *  The sidecar file objects/info/changed-paths has one line per commit:
+ *
+ *      <commit id> <timestamp> <parent ids, comma-separated, or -> <filter>
+ *
+ *  The filter, in hex, holds the names of the files the commit adds,
+ *  deletes or modifies relative to its first parent (every file, for a root
+ *  commit).  It is "-" if more than MAX_CHANGED_PATHS files changed, in
+ *  which case any path may have changed.  It has BITS_PER_PATH bits per
+ *  path (at least 64) and PROBES probes, derived by double hashing from one
+ *  64-bit hash of the name, for about 1% false positives.
+ *
+ *  A line is appended, with a single O_APPEND write, when a commit is made,
+ *  fetched or pushed, so concurrent writers never interleave; a reader
+ *  skips a torn last line, and the first line for a commit wins.  Commits
+ *  without a line (made before the sidecar existed, or borrowed from an
+ *  alternate) are simply read from the object store.  Since the line also
+ *  gives the parents and timestamp, a walk never reads a commit that the
+ *  filter rules out. */
+class ChangedPaths {
+public:
+    static const size_t MAX_CHANGED_PATHS = 512;
+    static const size_t BITS_PER_PATH = 10;
+    static const int PROBES = 7;
+
+    struct Record {
+        std::time_t timestamp = 0;
+        std::vector<ObjectId> parents;
+        std::string filter; // raw bits; empty if any path may have changed
+    };
+
+    /** Loads the sidecar of the objects directory OBJECTSDIR. */
+    explicit ChangedPaths(const std::string& objectsDir = ".gitlite/objects");
+
+    /** The line of commit COMMITID, or nullptr if it has none. */
+    const Record* find(const ObjectId& commitId) const { return records.find(commitId); }
+
+    /** Whether RECORD's commit may have changed PATH; false is certain. */
+    static bool mayChange(const Record& record, std::string_view path);
+
+    /** Appends the line of commit COMMITID, whose text is CONTENT and whose
+     *  first parent has the files PARENTFILES, to the sidecar of OBJECTSDIR. */
+    static void append(const std::string& objectsDir, const std::string& commitId, const std::string& content,
+                       const Manifest& parentFiles);
+
+    /** As above, reading the first parent from PARENTSTORE; for commits
+     *  copied from another repository. */
+    static void append(const std::string& objectsDir, const std::string& commitId, const std::string& content,
+                       const ObjectStore& parentStore);
+
+    /** Returns the Bloom filter of PATHS. */
+    static std::string buildFilter(const std::vector<std::string_view>& paths);
+
+private:
+    ObjectIdMap<Record> records;
+};
+
+#endif // CHANGEDPATHS_H
@@ -1,4 +1,29 @@
 #ifndef COMMIT_H
 #define COMMIT_H
 
+#include <ctime>
+#include <string>
+#include <vector>
+
+/** A parsed commit object: the "parent", "timestamp" and "message" lines.
+ *  The manifest ("files" line) is parsed by Manifest::fromCommit. */
+class Commit {
+public:
+    std::string id;
+    std::vector<std::string> parents;
+    std::time_t timestamp = 0;
+    std::string message;
+
+    /** Parses CONTENT, the stored contents of commit ID.  Throws
+     *  GitliteException if CONTENT is not a commit. */
+    static Commit parse(const std::string& id, const std::string& content);
+
+    /** Reads and parses commit ID from the object store. */
+    static Commit read(const std::string& id);
+
+    /** Formats TIME in local time the way log prints it, e.g.
+     *  "Thu Jan 01 08:00:00 1970 +0800". */
+    static std::string formatDate(std::time_t time);
+};
+
 #endif // COMMIT_H
@@ -0,0 +1,34 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+
+/** A small LZ77 codec producing the LZ4 block format.
+ *
+ *  Level 1 is a greedy single-probe matcher (fast, like LZ4's default);
+ *  levels 2-9 keep hash chains and try up to 2^(level-1) earlier positions
+ *  for the longest match, trading compression speed for ratio.
+ *  Decompression speed does not depend on the level. */
+class Compression {
+public:
+    static const int MAX_LEVEL = 9;
+
+    /** Largest possible compressed size of SIZE input bytes. */
+    static size_t compressBound(size_t size);
+
+    /** Compresses SIZE bytes at SRC into DST, which must hold
+     *  compressBound(SIZE) bytes.  Returns the compressed size. */
+    static size_t compress(const char* src, size_t size, char* dst, int level);
+
+    /** Decompresses SIZE bytes at SRC straight into DST, which must hold
+     *  exactly RAWSIZE bytes.  Returns false if the input is malformed or
+     *  does not decode to exactly RAWSIZE bytes. */
+    static bool decompress(const char* src, size_t size, char* dst, size_t rawSize);
+
+    /** Decompresses only the first LENGTH bytes of the SIZE bytes at SRC
+     *  into DST, which must hold LENGTH bytes; SRC may be cut short after
+     *  them.  Returns false if the input is malformed or runs out first. */
+    static bool decompressPrefix(const char* src, size_t size, char* dst, size_t length);
+};
+
+#endif // COMPRESSION_H
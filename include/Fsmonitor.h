@@ -0,0 +1,64 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+/** The optional filesystem-monitor daemon ("gitlite fsmonitor").
+ *
+ *  The daemon watches the working directory with inotify and keeps a journal
+ *  of the names that changed, each stamped with a sequence number.  Clients
+ *  connect to the Unix socket .gitlite/fsmonitor.sock and ask which names
+ *  changed since a token ("<daemon instance>:<sequence>") they got earlier.
+ *  A token from another daemon instance, or from before an inotify queue
+ *  overflow, cannot be answered precisely; the client must then rescan. */
+class Fsmonitor {
+public:
+    /** Starts the daemon for the repository in the current directory.  Unless
+     *  FOREGROUND, returns once the daemon is listening and leaves it running
+     *  in the background.  Throws GitliteException if one is already running. */
+    static void start(bool foreground);
+
+    /** Asks a running daemon to exit.  Returns false if none is running. */
+    static bool stop();
+
+    /** Asks the daemon which names changed since TOKEN, storing them in
+     *  CHANGED and the token for the current state in NEWTOKEN.  Returns false
+     *  if the caller must rescan everything instead; NEWTOKEN is left empty
+     *  when no daemon is reachable. */
+    static bool changedSince(const std::string& token, std::string& newToken,
+                             std::set<std::string>& changed);
+};
+
+/** The plain files in the working directory, with the content hashes
+ *  (blob IDs) computed for them so far.  When the fsmonitor daemon is
+ *  running, the previous snapshot is kept in .gitlite/fsmonitor-cache and
+ *  load() only re-examines the names the daemon reports as changed. */
+class WorktreeSnapshot {
+public:
+    /** Lists the working directory, incrementally when possible. */
+    void load();
+
+    /** Writes the snapshot for the next load(); a no-op without a daemon. */
+    void save();
+
+    /** True if the snapshot is kept up to date by the daemon. */
+    bool monitored() const { return !token.empty(); }
+
+    const std::set<std::string>& files() const { return fileSet; }
+
+    /** Returns the blob ID of working file FILE, reading it only if it
+     *  changed since it was last hashed.  Safe to call from several threads. */
+    std::string hash(const std::string& file);
+
+private:
+    std::mutex mutex; // guards hashes and dirty during hash()
+    std::string token;
+    std::set<std::string> fileSet;
+    std::map<std::string, std::string> hashes;
+    bool dirty = false;
+};
+
+#endif // FSMONITOR_H
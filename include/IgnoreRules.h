@@ -0,0 +1,60 @@
+#ifndef IGNORERULES_H
+#define IGNORERULES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** The ignore rules of a working tree, read from .gitliteignore.
+ *
+ *  Patterns follow gitignore: blank lines and "#" comments are skipped, "!"
+ *  re-includes, a trailing "/" matches directories only, and a pattern with
+ *  a "/" before its end is anchored at the top of the working tree while
+ *  one without matches a name at any depth.  "*", "?" and "[...]" match
+ *  within one path component; "**" matches across them when it is a whole
+ *  leading, trailing or inner component.  The last matching pattern
+ *  decides, and a file inside an ignored directory stays ignored.
+ *
+ *  Each pattern is compiled once into the cheapest test that implements
+ *  it: an exact name, a literal suffix ("*.log"), a literal prefix
+ *  ("tmp*"), or a general glob.  Only untracked files are ever ignored:
+ *  callers check tracked files first. */
+class IgnoreRules {
+public:
+    static const char* const FILE_NAME;
+
+    /** No rules: nothing is ignored. */
+    IgnoreRules() = default;
+
+    /** Reads the rules of the working tree in the current directory. */
+    static IgnoreRules load();
+
+    /** Compiles the rules in TEXT, in .gitliteignore syntax. */
+    static IgnoreRules parse(const std::string& text);
+
+    bool empty() const { return rules.empty(); }
+
+    /** Whether PATH (relative to the top of the working tree, "/"-separated)
+     *  is ignored; ISDIRECTORY says whether it names a directory. */
+    bool ignored(std::string_view path, bool isDirectory = false) const;
+
+private:
+    enum Kind { EXACT, SUFFIX, PREFIX, GLOB };
+
+    struct Rule {
+        Kind kind;
+        std::string pattern; // the literal part for EXACT, SUFFIX and PREFIX
+        bool negated;
+        bool directoryOnly;
+        bool anchored;       // matched against the whole path, not the last name
+    };
+
+    /** Whether the last rule matching PATH excludes it, ignoring parents. */
+    bool excluded(std::string_view path, bool isDirectory) const;
+
+    static bool matches(const Rule& rule, std::string_view text);
+
+    std::vector<Rule> rules;
+};
+
+#endif // IGNORERULES_H
@@ -0,0 +1,29 @@
+#ifndef LINEDIFF_H
+#define LINEDIFF_H
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+/** A line diff: which lines of a new version are kept from an old one.
+ *
+ *  Lines are interned to integers first, so the diff itself compares
+ *  integers only.  Common leading and trailing lines are matched directly;
+ *  the rest is a shortest edit script found by Myers' O(ND) algorithm in
+ *  its linear-space form (bisecting on the middle snake), so versions that
+ *  differ in D lines cost about (N + M) * D steps and O(N + M) memory. */
+class LineDiff {
+public:
+    static const size_t NONE = static_cast<size_t>(-1);
+
+    /** Splits TEXT into its lines, without their "\n"; a last line without
+     *  one still counts.  The views point into TEXT. */
+    static std::vector<std::string_view> splitLines(std::string_view text);
+
+    /** Returns, for each line of NEWLINES, the index of the line of
+     *  OLDLINES it is kept from, or NONE if it was added. */
+    static std::vector<size_t> match(const std::vector<std::string_view>& oldLines,
+                                     const std::vector<std::string_view>& newLines);
+};
+
+#endif // LINEDIFF_H
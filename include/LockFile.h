@@ -0,0 +1,63 @@
+#ifndef LOCKFILE_H
+#define LOCKFILE_H
+
+#include <random>
+#include <string>
+
+/** An exclusive lock on a file, held by creating "<path>.lock".
+ *
+ *  Creating the lock file is atomic (O_CREAT | O_EXCL), so at most one
+ *  process holds it; others retry with exponential backoff for up to
+ *  TIMEOUT_MS before giving up with a GitliteException.  A writer puts the
+ *  new contents into the lock file and commit()s, which renames it over the
+ *  target: readers never lock, and always see either the old or the new
+ *  contents in full.  The lock is released (and uncommitted contents
+ *  dropped) when the LockFile is destroyed.
+ *
+ *  A lock left behind by a crashed process must be removed by hand; the
+ *  error message names it. */
+class LockFile {
+public:
+    static const int TIMEOUT_MS = 10000;
+
+    /** Locks PATH, waiting for another holder if needed. */
+    explicit LockFile(const std::string& path);
+    ~LockFile();
+
+    LockFile(const LockFile&) = delete;
+    LockFile& operator=(const LockFile&) = delete;
+
+    /** Writes CONTENT to the lock file, to be installed by commit(). */
+    void write(const std::string& content);
+
+    /** Atomically replaces the target with the written contents and releases
+     *  the lock. */
+    void commit();
+
+    /** Releases the lock, leaving the target as it was. */
+    void release();
+
+    const std::string& lockPath() const { return path; }
+
+private:
+    std::string target;
+    std::string path;
+    int fd = -1;
+    bool held = false;
+};
+
+/** Exponential backoff from 1 ms to 128 ms, with jitter so that processes
+ *  retrying the same thing do not do so in lockstep. */
+class Backoff {
+public:
+    Backoff();
+
+    /** Sleeps for the next delay. */
+    void wait();
+
+private:
+    std::minstd_rand jitter;
+    int delayMs = 1;
+};
+
+#endif // LOCKFILE_H
@@ -0,0 +1,105 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include "ObjectId.h"
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/** A commit's manifest: file names mapped to blob IDs, sorted by name.
+ *
+ *  Names are views into one buffer holding the "name:blob;" text they were
+ *  parsed from and blob IDs are binary ObjectIds, so parsing allocates two
+ *  blocks however many files there are.  The buffer and entries are
+ *  immutable and shared: copying a Manifest is as cheap as copying a
+ *  shared_ptr. */
+class Manifest {
+public:
+    struct Entry {
+        std::string_view name;
+        ObjectId blobId;
+    };
+
+    /** An empty manifest. */
+    Manifest();
+
+    /** Parses the "files" line of commit object CONTENT. */
+    static Manifest fromCommit(std::string content);
+
+    /** Builds a manifest from (name, blob ID) pairs in any order; for a name
+     *  given twice, the later pair wins.  Unlike fromCommit, this keeps
+     *  "DELETE" markers, as null IDs, so that staged changes can be joined
+     *  too. */
+    static Manifest fromEntries(const std::vector<std::pair<std::string, std::string>>& entries);
+
+    size_t size() const { return data->entries.size(); }
+    bool empty() const { return data->entries.empty(); }
+    std::vector<Entry>::const_iterator begin() const { return data->entries.begin(); }
+    std::vector<Entry>::const_iterator end() const { return data->entries.end(); }
+
+    /** Returns the entry for NAME (binary search), or nullptr. */
+    const Entry* find(std::string_view name) const;
+
+    bool contains(std::string_view name) const { return find(name) != nullptr; }
+
+    /** Returns the blob ID of NAME, or the null ID if it is not listed. */
+    ObjectId blobId(std::string_view name) const;
+
+    /** Returns the manifest as the body of a "files" line: "a:blob;b:blob;". */
+    std::string serialize() const;
+
+    std::map<std::string, std::string> toMap() const;
+
+    /** Walks several manifests side by side in name order, visiting each
+     *  name listed in any of them once: a linear merge join.
+     *
+     *      Manifest::Join join({&ours, &theirs});
+     *      while (join.next()) {
+     *          if (join.blobId(0) != join.blobId(1)) ...
+     *      }
+     */
+    class Join {
+    public:
+        explicit Join(std::initializer_list<const Manifest*> manifests);
+
+        /** Moves to the next name.  Returns false when all are exhausted. */
+        bool next();
+
+        std::string_view name() const { return current; }
+
+        /** Whether manifest I lists the current name. */
+        bool has(size_t i) const { return present[i]; }
+
+        /** The current name's blob ID in manifest I, or the null ID. */
+        ObjectId blobId(size_t i) const {
+            return present[i] ? positions[i][-1].blobId : ObjectId();
+        }
+
+    private:
+        std::vector<const Manifest*> manifests;
+        std::vector<std::vector<Entry>::const_iterator> positions; // next unvisited entry
+        std::vector<char> present;
+        std::string_view current;
+    };
+
+private:
+    struct Data {
+        std::string text;
+        std::vector<Entry> entries;
+    };
+
+    explicit Manifest(std::shared_ptr<const Data> data) : data(std::move(data)) {}
+
+    /** Parses TEXT[BEGIN, END) as "name:blob;" pairs into a manifest.  An
+     *  entry whose blob is not an ID is dropped, or kept with the null ID if
+     *  KEEPDELETES. */
+    static Manifest parse(std::string text, size_t begin, size_t end, bool keepDeletes);
+
+    std::shared_ptr<const Data> data;
+};
+
+#endif // MANIFEST_H
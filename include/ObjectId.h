@@ -0,0 +1,200 @@
+#ifndef OBJECTID_H
+#define OBJECTID_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/** A 20-byte SHA-1 object ID.
+ *
+ *  IDs are kept as 40-character hex strings on disk (object file names,
+ *  refs, commit text); in memory, graph walks and manifests use this form,
+ *  which needs no allocation and compares and hashes in a few instructions.
+ *  The all-zero ID is the null ID. */
+class ObjectId {
+public:
+    static const size_t SIZE = 20;
+    static const size_t HEX_SIZE = 40;
+
+    /** The null ID. */
+    ObjectId() : bytes() {}
+
+    /** Parses HEX, which must be exactly 40 hex digits, into ID.  Returns
+     *  false (leaving ID unchanged) otherwise. */
+    static bool parse(std::string_view hex, ObjectId& id);
+
+    /** Parses HEX; returns the null ID if it is not a valid ID. */
+    static ObjectId fromHex(std::string_view hex);
+
+    std::string hex() const;
+
+    /** Appends the 40 hex digits of this ID to OUT. */
+    void appendHex(std::string& out) const;
+
+    bool isNull() const { return *this == ObjectId(); }
+
+    /** The first bytes of the ID: SHA-1 output is uniform, so they make a
+     *  good hash as they are. */
+    size_t hash() const {
+        size_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return value;
+    }
+
+    bool operator==(const ObjectId& other) const { return std::memcmp(bytes, other.bytes, SIZE) == 0; }
+    bool operator!=(const ObjectId& other) const { return !(*this == other); }
+    bool operator<(const ObjectId& other) const { return std::memcmp(bytes, other.bytes, SIZE) < 0; }
+
+private:
+    unsigned char bytes[SIZE];
+};
+
+struct ObjectIdHash {
+    size_t operator()(const ObjectId& id) const { return id.hash(); }
+};
+
+/** An open-addressing (linear probing) hash map from ObjectId to V.
+ *
+ *  Slots live in one array, so a lookup is usually a single cache miss.
+ *  The slot comes from the high bits of the folded hash times a Fibonacci
+ *  constant, which spreads even IDs that share most of their bytes.
+ *  Inserting may move every value: pointers and references from find(),
+ *  insert() and operator[] are valid only until the next insertion. */
+template <typename V>
+class ObjectIdMap {
+public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    bool contains(const ObjectId& id) const { return slotOf(id) != NONE; }
+
+    V* find(const ObjectId& id) {
+        size_t slot = slotOf(id);
+        return slot == NONE ? nullptr : &slots[slot].second;
+    }
+    const V* find(const ObjectId& id) const {
+        size_t slot = slotOf(id);
+        return slot == NONE ? nullptr : &slots[slot].second;
+    }
+
+    /** Inserts (ID, VALUE) unless ID is present.  Returns the stored value
+     *  and whether it was inserted. */
+    std::pair<V*, bool> insert(const ObjectId& id, V value = V()) {
+        if ((count + 1) * 4 > slots.size() * 3) {
+            rehash(slots.empty() ? 16 : slots.size() * 2);
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t slot = home(id);; slot = (slot + 1) & mask) {
+            if (!used[slot]) {
+                used[slot] = true;
+                slots[slot] = {id, std::move(value)};
+                ++count;
+                return {&slots[slot].second, true};
+            }
+            if (slots[slot].first == id) {
+                return {&slots[slot].second, false};
+            }
+        }
+    }
+
+    V& operator[](const ObjectId& id) { return *insert(id).first; }
+
+    /** Makes room for N entries without rehashing. */
+    void reserve(size_t n) {
+        size_t capacity = 16;
+        while (capacity * 3 < n * 4) {
+            capacity *= 2;
+        }
+        if (capacity > slots.size()) {
+            rehash(capacity);
+        }
+    }
+
+    void clear() {
+        slots.clear();
+        used.clear();
+        count = 0;
+    }
+
+    /** Calls F(id, value) for every entry, in no particular order. */
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t slot = 0; slot < slots.size(); ++slot) {
+            if (used[slot]) {
+                f(slots[slot].first, slots[slot].second);
+            }
+        }
+    }
+
+private:
+    static const size_t NONE = SIZE_MAX;
+
+    size_t home(const ObjectId& id) const {
+        uint64_t h = id.hash();
+        h ^= h >> 32; // the multiply only carries bits upwards
+        return static_cast<size_t>((h * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    size_t slotOf(const ObjectId& id) const {
+        if (slots.empty()) {
+            return NONE;
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t slot = home(id); used[slot]; slot = (slot + 1) & mask) {
+            if (slots[slot].first == id) {
+                return slot;
+            }
+        }
+        return NONE;
+    }
+
+    void rehash(size_t capacity) {
+        shift = 64;
+        for (size_t c = capacity; c > 1; c >>= 1) {
+            --shift;
+        }
+        std::vector<std::pair<ObjectId, V>> oldSlots(capacity);
+        std::vector<char> oldUsed(capacity, false);
+        oldSlots.swap(slots);
+        oldUsed.swap(used);
+        count = 0;
+        for (size_t slot = 0; slot < oldSlots.size(); ++slot) {
+            if (oldUsed[slot]) {
+                insert(oldSlots[slot].first, std::move(oldSlots[slot].second));
+            }
+        }
+    }
+
+    std::vector<std::pair<ObjectId, V>> slots; // capacity is a power of two
+    std::vector<char> used;
+    size_t count = 0;
+    int shift = 64; // 64 - log2(capacity)
+};
+
+/** An open-addressing hash set of ObjectIds (see ObjectIdMap). */
+class ObjectIdSet {
+public:
+    size_t size() const { return map.size(); }
+    bool empty() const { return map.empty(); }
+    bool contains(const ObjectId& id) const { return map.contains(id); }
+
+    /** Adds ID; returns false if it was already present. */
+    bool insert(const ObjectId& id) { return map.insert(id).second; }
+
+    void reserve(size_t n) { map.reserve(n); }
+    void clear() { map.clear(); }
+
+    template <typename F>
+    void forEach(F f) const {
+        map.forEach([&f](const ObjectId& id, const Empty&) { f(id); });
+    }
+
+private:
+    struct Empty {};
+    ObjectIdMap<Empty> map;
+};
+
+#endif // OBJECTID_H
@@ -0,0 +1,158 @@
+#ifndef OBJECTSTORE_H
+#define OBJECTSTORE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Object storage in an objects directory.
+ *
+ *  Every object is stored compressed (see Compression) behind a 13-byte
+ *  header: the magic "\0GLZ", a method byte (0 stored, 1 compressed) and the
+ *  uncompressed size as 8 little-endian bytes.  Objects that do not shrink
+ *  are stored as they are, and so are all objects written before compression
+ *  existed; read() tells them apart by the magic.  The level comes from the
+ *  GITLITE_COMPRESSION environment variable: 0 turns compression off, 1 (the
+ *  default) is fastest, 9 compresses best.
+ *
+ *  A blob's ID is always the SHA-1 of its contents.  Blobs smaller than
+ *  CHUNKING_THRESHOLD are stored as single objects.  Larger ones are cut into
+ *  content-defined chunks (FastCDC): each chunk is stored as an object named
+ *  by its own SHA-1, and the blob's object holds the chunk list
+ *
+ *      gitlite chunk-list
+ *      size <total bytes>
+ *      <chunk id> <chunk bytes>
+ *      ...
+ *
+ *  An edit therefore only produces new chunks around the change, and equal
+ *  chunks are shared between versions and files.  A stored chunk list's
+ *  chunks are always present: they are written, and copied between
+ *  repositories, before the list itself.
+ *
+ *  A store may borrow objects from alternates: other objects directories
+ *  listed one per line in info/alternates (relative paths are relative to
+ *  the objects directory; their own alternates are followed up to
+ *  MAX_ALTERNATE_DEPTH deep).  Reads look in the store itself first and
+ *  then in each alternate in order; writes always go to the store itself.
+ *  Which alternate holds an object, or that none does, is remembered for
+ *  the rest of the process by every store on the same directory, so a
+ *  repeated miss costs one stat however many alternates there are.
+ *  Alternates are treated as read-only: objects are never deleted from
+ *  them, and objects added to them while the process runs may go unseen.
+ *
+ *  Objects are written to a temporary file in the objects directory (named
+ *  TEMP_PREFIX and a unique suffix) and renamed into place, so readers,
+ *  which take no lock, see an object either whole or not at all. */
+class ObjectStore {
+public:
+    static const size_t CHUNKING_THRESHOLD = 256 * 1024;
+    static const size_t MIN_CHUNK = 16 * 1024;
+    static const size_t AVERAGE_CHUNK = 64 * 1024;
+    static const size_t MAX_CHUNK = 256 * 1024;
+    static const int MAX_ALTERNATE_DEPTH = 5;
+    static const char* const TEMP_PREFIX;
+
+    explicit ObjectStore(const std::string& objectsDir = ".gitlite/objects");
+
+    bool contains(const std::string& id) const;
+
+    /** Returns the ID of the first object, in ID order, whose ID starts with
+     *  PREFIX, looking in the alternates too; "" if there is none. */
+    std::string findByPrefix(const std::string& prefix) const;
+
+    /** Returns the contents of object ID.  Throws GitliteException if its
+     *  compressed form is damaged. */
+    std::string read(const std::string& id) const;
+
+    /** Sets CONTENT to the contents of object ID; returns false if it is
+     *  missing or damaged. */
+    bool read(const std::string& id, std::string& content) const;
+
+    /** Stores CONTENT as object ID, compressed at the configured level. */
+    void write(const std::string& id, const std::string& content) const;
+
+    /** Copies object ID, as stored, into OTHER. */
+    void copyTo(const std::string& id, const ObjectStore& other) const;
+
+    /** Puts object ID, as stored, into OTHER sharing its storage where the
+     *  filesystems allow: a hard link, else a reflink (FICLONE), else a
+     *  copy.  Stored objects never change, so the two stores cannot tell. */
+    void linkTo(const std::string& id, const ObjectStore& other) const;
+
+    /** Returns the stored form of CONTENT at compression LEVEL. */
+    static std::string encode(const std::string& content, int level);
+
+    /** Decodes stored object bytes STORED into CONTENT; returns false if
+     *  they are damaged. */
+    static bool decode(const std::string& stored, std::string& content);
+
+    /** The compression level for new objects (GITLITE_COMPRESSION). */
+    static int compressionLevel();
+
+    /** Stores CONTENT as blob BLOBID, or freshens it (and its chunks) if it
+     *  is already stored, so that a concurrent gc keeps it. */
+    void writeBlob(const std::string& blobId, const std::string& content) const;
+
+    /** Returns the contents of blob BLOBID, joining its chunks if needed. */
+    std::string readBlob(const std::string& blobId) const;
+
+    /** Writes blob BLOBID to file PATH one chunk at a time. */
+    void checkoutBlob(const std::string& blobId, const std::string& path) const;
+
+    /** Returns the chunk IDs of blob BLOBID; empty if it is stored whole. */
+    std::vector<std::string> chunksOf(const std::string& blobId) const;
+
+    /** Returns the size of blob BLOBID's contents, chunks joined, reading
+     *  only its frame header or its chunk list.  Sets CHUNKIDS, if given, as
+     *  chunksOf would. */
+    uint64_t blobSize(const std::string& blobId, std::vector<std::string>* chunkIds = nullptr) const;
+
+    /** Copies blob BLOBID into OTHER if OTHER lacks it, sending only the
+     *  chunks OTHER does not have yet. */
+    void copyBlobTo(const std::string& blobId, const ObjectStore& other) const;
+
+    /** True if object contents CONTENT are a chunk list. */
+    static bool isChunkList(const std::string& content);
+
+    /** Returns the chunk IDs listed in chunk list CONTENT. */
+    static std::vector<std::string> parseChunkList(const std::string& content);
+
+    /** True if NAME, a file in an objects directory, is a temporary file
+     *  of a write in progress (or of one that was interrupted). */
+    static bool isTemporary(const std::string& name);
+
+    /** Returns the end offset of each content-defined chunk of DATA. */
+    static std::vector<size_t> chunkBoundaries(const std::string& data);
+
+private:
+    struct Alternates;
+
+    /** The path of object ID in this store itself, where it is written. */
+    std::string path(const std::string& id) const;
+
+    /** If blob BLOBID is chunked, reads its chunk list into LIST and returns
+     *  true.  Sets SIZE to the size of the blob's contents either way. */
+    bool peek(const std::string& blobId, std::string& list, uint64_t& size) const;
+
+    /** Returns a new temporary path in the objects directory of STORE. */
+    static std::string temporaryPath(const ObjectStore& store);
+
+    /** Writes STORED, an object as stored, as object ID of OTHER: to a
+     *  temporary file first, then renamed into place. */
+    static void install(const ObjectStore& other, const std::string& id, const std::string& stored);
+
+    /** Sets WHERE to the path of object ID in this store or the first
+     *  alternate that has it; returns false if none has. */
+    bool locate(const std::string& id, std::string& where) const;
+
+    /** The path to read object ID from: where locate() finds it, else the
+     *  path in this store (whose reading fails as usual). */
+    std::string readPath(const std::string& id) const;
+
+    std::string objectsDir;
+    std::shared_ptr<Alternates> alternates; // null if there are none
+};
+
+#endif // OBJECTSTORE_H
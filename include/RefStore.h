@@ -0,0 +1,85 @@
+#ifndef REFSTORE_H
+#define REFSTORE_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/** The refs of a repository: HEAD and the branch heads under refs/heads.
+ *
+ *  Refs are named by their path inside the .gitlite directory, e.g. "HEAD"
+ *  or "refs/heads/master".  A ref is stored either loose, as a file of that
+ *  name, or in the packed-refs file, which holds one "<id> <name>" line per
+ *  ref sorted by name and is searched in place by bisection.  A loose ref
+ *  overrides a packed one; pack() moves every loose ref into the packed file.
+ *
+ *  Readers take no locks.  Every update takes the ref's own LockFile and
+ *  replaces the loose file by renaming the lock over it, so a reader sees
+ *  either the old value or the new one.  compareAndSwap() additionally
+ *  checks, under the lock, that the ref still holds the value the caller
+ *  based its update on; a caller that loses the race re-reads and retries,
+ *  or gives up.  Updates of different refs never wait for each other, except
+ *  that deleting a packed ref rewrites the packed file under its own lock.
+ *
+ *  In a linked worktree only HEAD is the worktree's own; every other ref is
+ *  read from and written to the main .gitlite directory (see Worktree). */
+class RefStore {
+public:
+    explicit RefStore(const std::string& gitliteDir = ".gitlite");
+
+    /** Returns the value of ref NAME, or "" if it does not exist. */
+    std::string read(const std::string& name) const;
+
+    bool exists(const std::string& name) const { return !read(name).empty(); }
+
+    /** Sets ref NAME to VALUE whatever it held before. */
+    void write(const std::string& name, const std::string& value) const;
+
+    /** Sets ref NAME to VALUE if it still holds EXPECTED ("" meaning that it
+     *  must not exist).  Returns false, changing nothing, otherwise. */
+    bool compareAndSwap(const std::string& name, const std::string& expected,
+                        const std::string& value) const;
+
+    /** Deletes ref NAME if it holds EXPECTED.  Returns false otherwise. */
+    bool remove(const std::string& name, const std::string& expected) const;
+
+    /** Moves every loose ref under refs/ into the packed-refs file and
+     *  removes the directories this empties.  Returns the number of refs in
+     *  the packed file. */
+    size_t pack() const;
+
+    /** The branch HEAD refers to. */
+    std::string currentBranch() const;
+
+    /** The commit ID of branch BRANCH, or "" if there is no such branch. */
+    std::string branchHead(const std::string& branch) const;
+
+    /** Returns every branch name, remote-tracking ones ("origin/master")
+     *  included, sorted. */
+    std::vector<std::string> branches() const;
+
+    /** Returns the local branch names, sorted. */
+    std::vector<std::string> localBranches() const;
+
+    static std::string branchRef(const std::string& branch) { return "refs/heads/" + branch; }
+
+private:
+    std::string path(const std::string& name) const {
+        return (name == "HEAD" ? gitliteDir : commonDir) + "/" + name;
+    }
+
+    /** Returns every ref under refs/heads, loose or packed, as sorted
+     *  (name, value) pairs. */
+    std::vector<std::pair<std::string, std::string>> allRefs() const;
+
+    /** Returns the loose refs under refs/heads, sorted by name. */
+    std::vector<std::string> looseRefs() const;
+
+    /** Returns the packed refs as sorted (name, value) pairs. */
+    std::vector<std::pair<std::string, std::string>> packedRefs() const;
+
+    std::string gitliteDir;
+    std::string commonDir; // where the shared refs live
+};
+
+#endif // REFSTORE_H
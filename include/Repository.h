@@ -1,4 +1,90 @@
 #ifndef REPOSITORY_H
 #define REPOSITORY_H
 
+#include "Commit.h"
+#include "Manifest.h"
+#include "SomeObj.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+/** The embeddable libgitlite API.
+ *
+ *  A Repository wraps the working directory WORKDIR.  Every method runs with
+ *  WORKDIR as the current directory (and restores the previous one), so a
+ *  process may hold several Repository objects, but must not use them from
+ *  more than one thread at a time.  Failures throw GitliteException carrying
+ *  the same message the command-line tool prints; informational output
+ *  (e.g. "Current branch fast-forwarded.") goes to the stream given at
+ *  construction. */
+class Repository {
+public:
+    explicit Repository(const std::string& workDir = ".", std::ostream& out = std::cout);
+
+    /** Creates a new repository in WORKDIR and returns it. */
+    static Repository init(const std::string& workDir, std::ostream& out = std::cout);
+
+    /** Clones the repository in SOURCEDIR into WORKDIR, which must not
+     *  exist or be an empty directory, and returns the clone.  Both paths are
+     *  relative to the current directory. */
+    static Repository clone(const std::string& sourceDir, const std::string& workDir,
+                            std::ostream& out = std::cout);
+
+    /** Runs one command-line invocation (ARGS excludes the program name),
+     *  writing its output to the stream given at construction.  Returns the
+     *  process exit status.  "fsmonitor" may only stop the daemon: starting
+     *  it forks, which is left to the command-line tool. */
+    int execute(const std::vector<std::string>& args);
+
+    // Queries
+    bool isInitialized();
+    std::string currentBranch();
+    std::string headCommitId();
+    std::vector<std::string> branches();
+    Commit readCommit(const std::string& commitId);
+    std::vector<Commit> log();
+    Manifest filesInCommit(const std::string& commitId);
+    StatusReport status();
+
+    // Commands
+    void add(const std::string& filename);
+    void addAll();
+    std::string commit(const std::string& message);
+    void rm(const std::string& filename);
+    void checkoutFile(const std::string& filename);
+    void checkoutFile(const std::string& commitId, const std::string& filename);
+    void checkoutBranch(const std::string& branchName);
+    void branch(const std::string& branchName);
+    void rmBranch(const std::string& branchName);
+    void reset(const std::string& commitId);
+    void merge(const std::string& branchName);
+    void addRemote(const std::string& remoteName, const std::string& remoteDir);
+    void rmRemote(const std::string& remoteName);
+    void push(const std::string& remoteName, const std::string& remoteBranchName);
+    void fetch(const std::string& remoteName, const std::string& remoteBranchName);
+    void pull(const std::string& remoteName, const std::string& remoteBranchName);
+    void gc(long long gracePeriodSeconds);
+    bool fsck();
+    void packRefs();
+    void addWorktree(const std::string& dir, const std::string& branchName);
+    void setSparseCheckout(const std::vector<std::string>& patterns);
+
+private:
+    /** Changes into the repository's working directory for one call. */
+    class WorkDirScope {
+    public:
+        explicit WorkDirScope(const std::string& workDir);
+        ~WorkDirScope();
+
+    private:
+        std::string previous;
+    };
+
+    void requireRepository();
+
+    std::string workDir;
+    SomeObj repo;
+};
+
 #endif // REPOSITORY_H
@@ -0,0 +1,109 @@
+#ifndef REVWALK_H
+#define REVWALK_H
+
+#include "ChangedPaths.h"
+#include "Commit.h"
+#include "ObjectId.h"
+#include "ObjectStore.h"
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+/** Walks commit history newest first, in commit-date order.
+ *
+ *  Start points are added with push(); commits reachable from a hide()
+ *  point are left out, which gives "A..B" ranges.  Commits are read only as
+ *  the walk reaches them, so asking for the first N commits of a long
+ *  history costs about N reads.  With equal timestamps, hidden commits are
+ *  processed first, so a hidden commit is never shown as long as parents
+ *  are no newer than their children.
+ *
+ *  With setPath(), only commits that change a path relative to their first
+ *  parent are shown.  Commits with a line in the changed-paths sidecar take
+ *  their parents and timestamp from it, and those whose filter rules the
+ *  path out are passed over without reading the commit object. */
+class RevWalk {
+public:
+    /** Adds commit COMMITID as a starting point. */
+    void push(const std::string& commitId);
+
+    /** Excludes commit COMMITID and all of its ancestors. */
+    void hide(const std::string& commitId);
+
+    /** Follows only the first parent of merge commits (the default). */
+    void setFirstParent(bool firstParent) { this->firstParent = firstParent; }
+
+    /** Stops after N commits; a negative N means no limit. */
+    void setMaxCount(long long n) { maxCount = n; }
+
+    /** Shows only commits made at or after SINCE; the walk ends at the first
+     *  older commit. */
+    void setSince(std::time_t since) { this->since = since; hasSince = true; }
+
+    /** Skips commits made after UNTIL. */
+    void setUntil(std::time_t until) { this->until = until; hasUntil = true; }
+
+    /** Shows only commits that add, delete or modify file PATH. */
+    void setPath(const std::string& path);
+
+    /** Stores the next commit in COMMIT.  Returns false when the walk is over. */
+    bool next(Commit& commit);
+
+private:
+    struct Node {
+        Commit commit;                  // only id and timestamp until parsed
+        std::vector<ObjectId> parents;
+        const ChangedPaths::Record* record = nullptr;
+        bool parsed = false;
+        bool hidden = false;
+        bool queued = false;
+        bool done = false;
+    };
+
+    struct Entry {
+        std::time_t timestamp;
+        bool hidden;
+        unsigned long long order;
+        Node* node;
+    };
+
+    /** Newest first; at equal times hidden entries, then earlier insertions. */
+    struct Later {
+        bool operator()(const Entry& a, const Entry& b) const {
+            if (a.timestamp != b.timestamp) {
+                return a.timestamp < b.timestamp;
+            }
+            if (a.hidden != b.hidden) {
+                return b.hidden;
+            }
+            return a.order > b.order;
+        }
+    };
+
+    Node* lookup(const ObjectId& commitId);
+    bool parse(Node* node, std::string& content);
+    bool changesPath(Node* node);
+    void enqueue(Node* node);
+    void markHidden(Node* node);
+
+    ObjectStore store;
+    std::unique_ptr<ChangedPaths> changedPaths; // loaded by setPath
+    std::string path;
+    std::deque<Node> nodes;              // stable addresses for queue entries
+    ObjectIdMap<Node*> index;            // nullptr: no such commit
+    std::priority_queue<Entry, std::vector<Entry>, Later> queue;
+    unsigned long long insertions = 0;
+    size_t visibleQueued = 0;
+    bool firstParent = true;
+    long long maxCount = -1;
+    long long shown = 0;
+    bool hasSince = false;
+    bool hasUntil = false;
+    std::time_t since = 0;
+    std::time_t until = 0;
+};
+
+#endif // REVWALK_H
@@ -1,23 +1,45 @@
 #ifndef SOMEOBJ_H
 #define SOMEOBJ_H
 
+#include "LockFile.h"
+#include "Manifest.h"
+#include "ObjectId.h"
+#include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <map>
 #include <set>
+#include <unordered_map>
+
+/** Result of SomeObj::getStatus(); every list is sorted. */
+struct StatusReport {
+    std::string currentBranch;
+    std::vector<std::string> branches;
+    std::vector<std::string> staged;
+    std::vector<std::string> removed;
+    std::map<std::string, std::string> modifications; // file -> "modified" or "deleted"
+    std::vector<std::string> untracked;
+};
 
 class SomeObj {
 public:
-    SomeObj();
+    /** Commands write their normal output to OUT; failures are reported by
+     *  throwing GitliteException. */
+    explicit SomeObj(std::ostream& out = std::cout);
     
     // Subtask 1 commands
     void init();
     void add(const std::string& filename);
+    void addAll();
     void commit(const std::string& message);
     void rm(const std::string& filename);
     
     // Subtask 2 commands
-    void log();
+    void log(const std::vector<std::string>& options = {});
+    void blame(const std::string& filename);
+    void grep(const std::string& pattern, const std::string& revision = "");
+    void archive(const std::string& revision, const std::string& outputPath = "");
     void globalLog();
     void find(const std::string& commitMessage);
     void checkoutFile(const std::string& filename);
@@ -26,6 +48,7 @@ public:
     
     // Subtask 3 commands
     void status();
+    StatusReport getStatus();
     
     // Subtask 4 commands
     void branch(const std::string& branchName);
@@ -41,12 +64,83 @@ public:
     void push(const std::string& remoteName, const std::string& remoteBranchName);
     void fetch(const std::string& remoteName, const std::string& remoteBranchName);
     void pull(const std::string& remoteName, const std::string& remoteBranchName);
+    void clone(const std::string& sourceDir, const std::string& destinationDir);
+
+    // Maintenance commands
+    void gc(long long gracePeriodSeconds);
+    bool fsck();
+    void packRefs();
+
+    // Worktrees
+    void addWorktree(const std::string& dir, const std::string& branchName);
+    void listWorktrees();
+
+    // Sparse checkout
+    void setSparseCheckout(const std::vector<std::string>& patterns);
+    void listSparseCheckout();
+
+    /** Forgets cached object parses (see getFilesInCommit). */
+    void clearCaches();
 
 private:
+    friend class SomeObjBench;
+    friend class Repository;
+
+    std::ostream& out;
+
+    /** Holds the staging-area lock (.gitlite/staging.lock) while in scope.
+     *  Commands that read or change the staging area take it, so concurrent
+     *  commands see and leave it consistent; guards nest, since commands
+     *  call one another (addAll calls add, for instance). */
+    class StagingLock {
+    public:
+        explicit StagingLock(SomeObj& owner);
+        ~StagingLock();
+        StagingLock(const StagingLock&) = delete;
+        StagingLock& operator=(const StagingLock&) = delete;
+
+    private:
+        SomeObj& owner;
+    };
+    std::unique_ptr<LockFile> stagingLock;
+    int stagingLockDepth = 0;
+
+    /** status compares files on a thread pool from this many files on. */
+    static const size_t PARALLEL_STATUS_THRESHOLD = 256;
+
+    /** gc removes temporary object files only once they are this old,
+     *  whatever the grace period, as younger ones may still be written. */
+    static const long long TEMPORARY_GRACE_SECONDS = 60 * 60;
+
+    /** Commits retry this many times when the branch moves under them. */
+    static const int REF_UPDATE_ATTEMPTS = 5;
+
+    /** archive reads at most this many files, and about this many bytes,
+     *  ahead of the one it is writing. */
+    static const size_t ARCHIVE_READ_AHEAD = 32;
+    static const size_t ARCHIVE_READ_AHEAD_BYTES = 64 << 20;
+
+    // Caches of immutable object parses, shared by every command run on this object
+    static const size_t MANIFEST_CACHE_LIMIT = 1 << 20;
+    std::unordered_map<std::string, Manifest> manifestCache;
+    size_t manifestCacheEntries = 0;
+    ObjectIdMap<std::vector<ObjectId>> parentCache;
+
     // Helper methods
-    std::map<std::string, std::string> getFilesInCommit(const std::string& commitId);
+    Manifest getFilesInCommit(const std::string& commitId);
+    std::string applyStaging(const Manifest& base);
+    std::vector<std::string> listWorkingFiles();
+    std::string resolveRevision(const std::string& revision);
     bool isFileTrackedInCommit(const std::string& filename, const std::string& commitId);
+    const std::vector<ObjectId>& getParents(const ObjectId& commitId);
     std::string findSplitPoint(const std::string& commitId1, const std::string& commitId2);
+    bool readCommitLinks(const ObjectId& commitId, std::vector<ObjectId>& parents,
+                         std::vector<ObjectId>& blobIds);
+    static bool parseParents(const std::string& content, std::vector<ObjectId>& parents);
+    static bool parseCommitLinks(const std::string& content, std::vector<ObjectId>& parents,
+                                 std::vector<ObjectId>& blobIds);
+    std::vector<std::string> getRefCommits();
+    std::vector<std::string> getStagedBlobs();
 };
 
 #endif // SOMEOBJ_H
\ No newline at end of file
@@ -0,0 +1,44 @@
+#ifndef SPARSECHECKOUT_H
+#define SPARSECHECKOUT_H
+
+#include "IgnoreRules.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** The sparse-checkout set: which tracked paths are materialized in the
+ *  working tree.
+ *
+ *  The patterns live in .gitlite/info/sparse-checkout, one per line, in
+ *  .gitliteignore syntax; a path is in the set if the last pattern matching
+ *  it is not negated.  Without the file every path is in the set.  Paths
+ *  outside the set stay in commits and in the staging area, but checkout,
+ *  reset and merge never write them and status neither scans nor compares
+ *  them. */
+class SparseCheckout {
+public:
+    static const char* const FILE_PATH;
+
+    /** Reads the set of the repository in the current directory. */
+    static SparseCheckout load();
+
+    /** The set given by PATTERNS; disabled if there are none. */
+    static SparseCheckout fromPatterns(const std::vector<std::string>& patterns);
+
+    /** Writes PATTERNS as the set; an empty list disables sparse checkout. */
+    static void save(const std::vector<std::string>& patterns);
+
+    bool enabled() const { return isEnabled; }
+
+    /** Whether PATH is materialized in the working tree. */
+    bool includes(std::string_view path) const { return !isEnabled || rules.ignored(path); }
+
+    const std::vector<std::string>& patterns() const { return lines; }
+
+private:
+    bool isEnabled = false;
+    std::vector<std::string> lines;
+    IgnoreRules rules; // "ignored" here means "matched"
+};
+
+#endif // SPARSECHECKOUT_H
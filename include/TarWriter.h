@@ -0,0 +1,49 @@
+#ifndef TARWRITER_H
+#define TARWRITER_H
+
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <string>
+
+/** Writes a POSIX (ustar) tar archive to a stream, one file at a time.
+ *
+ *  Each file is a 512-byte header followed by its content padded to a
+ *  multiple of 512 bytes, so nothing is held back between files and content
+ *  can be written in pieces.  A name that does not fit the header's name and
+ *  prefix fields, or a size of 8 GiB or more, which does not fit its octal
+ *  field, is given in a pax extended header.  finish() writes the two zero blocks that end the
+ *  archive and pads it to a whole 10240-byte record, as tar does. */
+class TarWriter {
+public:
+    static const size_t BLOCK_SIZE = 512;
+    static const size_t RECORD_SIZE = 20 * BLOCK_SIZE;
+
+    explicit TarWriter(std::ostream& out) : out(out) {}
+
+    /** Adds the regular file NAME, mode 0644, with CONTENT and modification
+     *  time MTIME. */
+    void addFile(const std::string& name, const std::string& content, std::time_t mtime);
+
+    /** Starts the regular file NAME, mode 0644, of SIZE bytes and modification
+     *  time MTIME; its content follows through write(). */
+    void addFile(const std::string& name, uint64_t size, std::time_t mtime);
+
+    /** Writes the next SIZE bytes of the current file's content, which must
+     *  not run past the size it was started with.  Pads the file once it is
+     *  complete. */
+    void write(const char* data, size_t size);
+
+    /** Ends the archive. */
+    void finish();
+
+private:
+    void writeHeader(const std::string& name, uint64_t size, std::time_t mtime, char type);
+    void writePadded(const std::string& data);
+
+    std::ostream& out;
+    uint64_t written = 0;
+    uint64_t remaining = 0; // content bytes the current file still needs
+};
+
+#endif // TARWRITER_H
@@ -0,0 +1,45 @@
+#ifndef TEXTSEARCH_H
+#define TEXTSEARCH_H
+
+#include <cstddef>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/** Finds the lines of a text that match a regular expression (ECMAScript
+ *  syntax).
+ *
+ *  Most lines of most files do not match, so the regex is kept off them:
+ *  the pattern is scanned for a literal that every match must contain (the
+ *  longest run of ordinary characters outside groups, classes and optional
+ *  atoms; none if it has an alternation), and only the lines holding that
+ *  literal are handed to the regex.  A pattern that is a plain literal needs
+ *  no regex at all.  The literal is found with findLiteral, which checks 16
+ *  positions at a time with SSE2.  A compiled TextSearch is read-only, so
+ *  one instance may search from several threads at once. */
+class TextSearch {
+public:
+    /** Compiles PATTERN; throws std::regex_error if it is not valid. */
+    explicit TextSearch(const std::string& pattern);
+
+    /** Appends to MATCHES the line number (from 1) and text, without its
+     *  "\n", of each line of TEXT that matches.  The views point into TEXT. */
+    void search(std::string_view text, std::vector<std::pair<size_t, std::string_view>>& matches) const;
+
+    /** The literal every match contains, or "" if none was found. */
+    const std::string& requiredLiteral() const { return literal; }
+
+    /** Returns the first occurrence of LITERAL in [BEGIN, END), or END. */
+    static const char* findLiteral(const char* begin, const char* end, std::string_view literal);
+
+private:
+    static std::string extractLiteral(const std::string& pattern, bool& plain);
+
+    std::string literal;
+    bool plain = false; // the pattern is LITERAL itself
+    std::regex regex;
+};
+
+#endif // TEXTSEARCH_H
@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** A fixed-size pool of worker threads with work stealing.
+ *
+ *  Every worker owns a task deque.  A task submitted from a worker goes to
+ *  the back of that worker's deque, which the worker drains from the back
+ *  (newest first, while its data is still in cache); tasks submitted from
+ *  outside are dealt round-robin.  A worker whose deque is empty steals the
+ *  oldest task from another's front, so uneven tasks even out without a
+ *  single shared queue.
+ *
+ *  Tasks may submit further tasks; wait() returns once every task submitted
+ *  so far (including those spawned by other tasks) has finished.  The first
+ *  exception thrown by a task is rethrown from wait(). */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    void wait();
+    unsigned size() const;
+
+    /** Number of workers used when none is requested explicitly. */
+    static unsigned defaultThreads();
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(unsigned index);
+
+    /** Takes a task from worker INDEX's own deque, or steals one. */
+    bool take(unsigned index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex; // guards everything below
+    std::condition_variable taskReady;
+    std::condition_variable allDone;
+    size_t queued;  // tasks in some deque
+    size_t pending; // tasks submitted but not finished
+    unsigned nextQueue;
+    bool stopping;
+    std::exception_ptr firstError;
+};
+
+#endif // THREAD_POOL_H
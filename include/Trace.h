@@ -0,0 +1,68 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+
+/** Structured tracing, enabled by setting GITLITE_TRACE=<file.json>.
+ *
+ *  Timed regions are recorded with the RAII Trace::Region and counters are
+ *  bumped with Trace::count().  On exit the trace is written in Chrome
+ *  trace-event format (load it in chrome://tracing or Perfetto).  When the
+ *  variable is unset, every hook is a single predictable branch. */
+class Trace {
+public:
+    enum Counter {
+        OBJECTS_READ,
+        OBJECTS_WRITTEN,
+        BYTES_READ,
+        BYTES_WRITTEN,
+        STAT_CALLS,
+        CACHE_HITS,
+        CACHE_MISSES,
+        LOCK_WAITS,
+        FILTER_SKIPS,
+        COUNTER_COUNT
+    };
+
+    /** Times the enclosing scope as an event named NAME.  NAME must stay
+     *  valid until the region ends. */
+    class Region {
+    public:
+        explicit Region(const char* name) : name(nullptr), start(0) {
+            if (active) {
+                begin(name);
+            }
+        }
+        ~Region() {
+            if (name != nullptr) {
+                end();
+            }
+        }
+        Region(const Region&) = delete;
+        Region& operator=(const Region&) = delete;
+
+    private:
+        void begin(const char* eventName);
+        void end();
+
+        const char* name;
+        int64_t start;
+    };
+
+    static bool enabled() { return active; }
+
+    static void count(Counter counter, int64_t delta = 1) {
+        if (active) {
+            counters[counter].fetch_add(delta, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    friend class TraceSession;
+
+    static bool active;
+    static std::atomic<int64_t> counters[COUNTER_COUNT];
+};
+
+#endif // TRACE_H
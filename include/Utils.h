@@ -57,6 +57,7 @@ public:
 
     // Directory operations
     static std::vector<std::string> plainFilenamesIn(const std::string& dirPath);
+    static std::vector<std::string> plainFilenamesUnder(const std::string& dirPath);
     static std::string join(const std::string& first, const std::string& second);
     static std::string join(const std::string& first, const std::string& second, const std::string& third);
 
@@ -71,7 +72,9 @@ public:
     static bool exists(const std::string& path);
     static bool isFile(const std::string& path);
     static bool isDirectory(const std::string& path);
+    static bool isEmptyDirectory(const std::string& path);
     static bool createDirectories(const std::string& path);
+    static bool touch(const std::string& path);
 };
 
 #endif // UTILS_H
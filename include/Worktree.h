@@ -0,0 +1,48 @@
+#ifndef WORKTREE_H
+#define WORKTREE_H
+
+#include <string>
+#include <vector>
+
+/** The worktrees of a repository: the main one, holding the repository's
+ *  .gitlite directory, and linked ones made by "worktree add".
+ *
+ *  A linked worktree has a .gitlite directory of its own for the state that
+ *  belongs to one working directory: HEAD, staging and the sparse-checkout
+ *  set.  A "commondir" file in it names the main .gitlite directory, where
+ *  RefStore keeps every ref but HEAD; objects/ and remotes/ are symlinks to
+ *  the main ones, so objects are stored once.  The main .gitlite directory
+ *  lists linked worktrees in worktrees/<name>, each holding the worktree's
+ *  absolute path.  An entry whose worktree has been deleted is ignored.
+ *
+ *  A branch is checked out in at most one worktree at a time; commands that
+ *  change which branch a worktree has checked out hold the worktrees lock
+ *  (worktrees.lock in the main .gitlite directory) while they check and
+ *  update HEAD. */
+class Worktree {
+public:
+    std::string path;   // absolute path of the top directory
+    std::string branch; // the branch checked out there
+
+    /** The .gitlite directory holding the refs and objects shared by the
+     *  worktrees of GITLITEDIR's repository. */
+    static std::string commonDir(const std::string& gitliteDir = ".gitlite");
+
+    /** Path of the worktrees lock, to be held with LockFile. */
+    static std::string lockPath();
+
+    /** The worktrees of the repository in the current directory, the main
+     *  one first. */
+    static std::vector<Worktree> list();
+
+    /** The path of a worktree other than the current one that has BRANCH
+     *  checked out, or "" if there is none. */
+    static std::string checkedOutElsewhere(const std::string& branch);
+
+    /** Creates the .gitlite directory of a new linked worktree DIR (which
+     *  must exist) with HEAD on BRANCH, and registers it.  The caller holds
+     *  the worktrees lock and writes the files. */
+    static void create(const std::string& dir, const std::string& branch);
+};
+
+#endif // WORKTREE_H
@@ -1,126 +1,116 @@
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <string>
-#include "include/SomeObj.h"
+#include "include/Fsmonitor.h"
 #include "include/Repository.h"
+#include "include/GitliteException.h"
 #include "include/Utils.h"
 
-void checkCWD() {
-    if (!Utils::isDirectory(".gitlite")) {
-        Utils::exitWithMessage("Not in an initialized Gitlite directory.");
+namespace {
+/** Splits one batch line into arguments on whitespace; double quotes group
+ *  words and a backslash escapes the next character.  Returns false if a
+ *  quote is left open. */
+bool splitCommandLine(const std::string& line, std::vector<std::string>& args) {
+    args.clear();
+    std::string current;
+    bool inWord = false;
+    bool inQuotes = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '\\' && i + 1 < line.size()) {
+            current += line[++i];
+            inWord = true;
+        } else if (c == '"') {
+            inQuotes = !inQuotes;
+            inWord = true;
+        } else if (!inQuotes && (c == ' ' || c == '\t' || c == '\r')) {
+            if (inWord) {
+                args.push_back(current);
+                current.clear();
+                inWord = false;
+            }
+        } else {
+            current += c;
+            inWord = true;
+        }
+    }
+    if (inWord) {
+        args.push_back(current);
     }
+    return !inQuotes;
 }
 
-void checkNoArgs(const std::vector<std::string>& args) {
-    if (args.empty()) {
-        Utils::exitWithMessage("Please enter a command.");
+/** Runs commands read from stdin, one per line, in a single process so that
+ *  commit and manifest caches are shared between them.  Each command is
+ *  answered with a header line "ok <status> <length>" (or "error ...") followed
+ *  by exactly LENGTH bytes of the output the command would have printed on its
+ *  own.  Blank lines are ignored. */
+int runBatch() {
+    std::ostringstream output;
+    Repository repository(".", output);
+    std::vector<std::string> args;
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        output.str("");
+        output.clear();
+        bool ok = false;
+        int status = 0;
+        try {
+            if (!splitCommandLine(line, args)) {
+                throw GitliteException("Unterminated quote.");
+            }
+            status = repository.execute(args);
+            ok = status == 0;
+        } catch (const GitliteException& e) {
+            output << e.what() << '\n';
+        } catch (const std::exception& e) {
+            output << e.what() << '\n';
+            status = 1;
+        }
+        std::string payload = output.str();
+        std::cout << (ok ? "ok " : "error ") << status << ' ' << payload.size() << '\n'
+                  << payload << std::flush;
     }
+    return 0;
 }
 
-void checkArgsNum(const std::vector<std::string>& args, int n) {
-    if (static_cast<int>(args.size()) != n) {
-        Utils::exitWithMessage("Incorrect operands.");
+/** Starts the fsmonitor daemon, in the background unless FOREGROUND.  Only
+ *  the command-line tool does this, as it forks (see Repository::execute). */
+int runFsmonitor(Repository& repository, bool foreground) {
+    if (!repository.isInitialized()) {
+        throw GitliteException("Not in an initialized Gitlite directory.");
     }
+    Fsmonitor::start(foreground);
+    return 0;
 }
+} // namespace
 
+/** The gitlite command-line tool: a thin wrapper around libgitlite.
+ *  Errors are printed as messages and, as the spec requires, still exit 0;
+ *  only fsck reports failure through the exit status. */
 int main(int argc, char* argv[]) {
     std::vector<std::string> args;
     for (int i = 1; i < argc; ++i) {
         args.push_back(std::string(argv[i]));
     }
-    
-    checkNoArgs(args);
-    SomeObj bloop;
-    std::string firstArg = args[0];
-    
-    if (firstArg == "init") {
-        checkArgsNum(args, 1);
-        bloop.init();
-    } else if (firstArg == "add-remote") {
-        checkCWD();
-        checkArgsNum(args, 3);
-        bloop.addRemote(args[1], args[2]);
-    } else if (firstArg == "rm-remote") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.rmRemote(args[1]);
-    } else if (firstArg == "add") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.add(args[1]);
-    } else if (firstArg == "commit") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.commit(args[1]);
-    } else if (firstArg == "rm") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.rm(args[1]);
-    } else if (firstArg == "log") {
-        checkCWD();
-        checkArgsNum(args, 1);
-        bloop.log();
-    } else if (firstArg == "global-log") {
-        checkCWD();
-        checkArgsNum(args, 1);
-        bloop.globalLog();
-    } else if (firstArg == "find") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.find(args[1]);
-    } else if (firstArg == "status") {
-        checkCWD();
-        checkArgsNum(args, 1);
-        bloop.status();
-    } else if (firstArg == "checkout") {
-        checkCWD();
-        if (args.size() == 2) {
-            bloop.checkoutBranch(args[1]);
-        } else if (args.size() == 3) {
-            if (args[1] != "--") {
-                Utils::exitWithMessage("Incorrect operands.");
-            }
-            bloop.checkoutFile(args[2]);
-        } else if (args.size() == 4) {
-            if (args[2] != "--") {
-                Utils::exitWithMessage("Incorrect operands.");
-            }
-            bloop.checkoutFileInCommit(args[1], args[3]);
-        } else {
-            Utils::exitWithMessage("Incorrect operands.");
+
+    if (args.size() == 1 && args[0] == "--batch") {
+        return runBatch();
+    }
+
+    try {
+        Repository repository(".");
+        if (!args.empty() && args[0] == "fsmonitor" &&
+            (args.size() == 1 || (args.size() == 2 && args[1] == "--foreground"))) {
+            return runFsmonitor(repository, args.size() == 2);
         }
-    } else if (firstArg == "branch") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.branch(args[1]);
-    } else if (firstArg == "rm-branch") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.rmBranch(args[1]);
-    } else if (firstArg == "reset") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.reset(args[1]);
-    } else if (firstArg == "merge") {
-        checkCWD();
-        checkArgsNum(args, 2);
-        bloop.merge(args[1]);
-    } else if (firstArg == "push") {
-        checkCWD();
-        checkArgsNum(args, 3);
-        bloop.push(args[1], args[2]);
-    } else if (firstArg == "fetch") {
-        checkCWD();
-        checkArgsNum(args, 3);
-        bloop.fetch(args[1], args[2]);
-    } else if (firstArg == "pull") {
-        checkCWD();
-        checkArgsNum(args, 3);
-        bloop.pull(args[1], args[2]);
-    } else {
-        std::cout << "No command with that name exists." << std::endl;
-        return 0;
+        return repository.execute(args);
+    } catch (const GitliteException& e) {
+        Utils::message(e.what());
     }
-    
     return 0;
 }
@@ -0,0 +1,165 @@
+#include "../include/ChangedPaths.h"
+#include "../include/Commit.h"
+#include "../include/Utils.h"
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+const char* const SIDECAR = "/info/changed-paths";
+const char HEX[] = "0123456789abcdef";
+
+/** A 64-bit hash of PATH: FNV-1a, then a finalizing mix so that both halves
+ *  are well distributed. */
+uint64_t pathHash(std::string_view path) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : path) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+/** Calls PROBE with each of the bit positions of PATH in a filter of BITS bits. */
+template <typename Probe>
+void forEachBit(std::string_view path, size_t bits, Probe probe) {
+    uint64_t hash = pathHash(path);
+    uint32_t h1 = static_cast<uint32_t>(hash);
+    uint32_t h2 = static_cast<uint32_t>(hash >> 32) | 1;
+    for (int i = 0; i < ChangedPaths::PROBES; ++i) {
+        probe((h1 + static_cast<uint64_t>(i) * h2) % bits);
+    }
+}
+
+int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+} // namespace
+
+const size_t ChangedPaths::MAX_CHANGED_PATHS;
+const size_t ChangedPaths::BITS_PER_PATH;
+const int ChangedPaths::PROBES;
+
+ChangedPaths::ChangedPaths(const std::string& objectsDir) {
+    std::ifstream file(objectsDir + SIDECAR, std::ios::binary);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (file.eof()) {
+            break; // no newline: torn by a writer still at work
+        }
+        // <id> <timestamp> <parents> <filter>
+        size_t idEnd = line.find(' ');
+        size_t timeEnd = idEnd == std::string::npos ? idEnd : line.find(' ', idEnd + 1);
+        size_t parentsEnd = timeEnd == std::string::npos ? timeEnd : line.find(' ', timeEnd + 1);
+        ObjectId id;
+        if (parentsEnd == std::string::npos || !ObjectId::parse(line.substr(0, idEnd), id) || records.contains(id)) {
+            continue;
+        }
+        Record record;
+        record.timestamp = static_cast<std::time_t>(std::strtoll(line.c_str() + idEnd + 1, nullptr, 10));
+        std::string parents = line.substr(timeEnd + 1, parentsEnd - timeEnd - 1);
+        for (size_t start = 0; parents != "-" && start < parents.size();) {
+            size_t comma = parents.find(',', start);
+            size_t end = comma == std::string::npos ? parents.size() : comma;
+            ObjectId parent;
+            if (ObjectId::parse(parents.substr(start, end - start), parent)) {
+                record.parents.push_back(parent);
+            }
+            start = end + 1;
+        }
+        std::string_view hex(line.data() + parentsEnd + 1, line.size() - parentsEnd - 1);
+        bool valid = hex.size() % 2 == 0;
+        for (size_t i = 0; valid && hex != "-" && i < hex.size(); i += 2) {
+            int high = hexValue(hex[i]);
+            int low = hexValue(hex[i + 1]);
+            valid = high >= 0 && low >= 0;
+            record.filter += static_cast<char>(high << 4 | low);
+        }
+        if (!valid && hex != "-") {
+            continue;
+        }
+        records.insert(id, std::move(record));
+    }
+}
+
+bool ChangedPaths::mayChange(const Record& record, std::string_view path) {
+    if (record.filter.empty()) {
+        return true;
+    }
+    size_t bits = record.filter.size() * 8;
+    bool present = true;
+    forEachBit(path, bits, [&record, &present](size_t bit) {
+        present = present && (static_cast<unsigned char>(record.filter[bit / 8]) >> (bit % 8) & 1);
+    });
+    return present;
+}
+
+std::string ChangedPaths::buildFilter(const std::vector<std::string_view>& paths) {
+    size_t bits = std::max<size_t>(64, paths.size() * BITS_PER_PATH);
+    std::string filter((bits + 7) / 8, '\0');
+    bits = filter.size() * 8;
+    for (const auto& path : paths) {
+        forEachBit(path, bits, [&filter](size_t bit) {
+            filter[bit / 8] = static_cast<char>(filter[bit / 8] | 1 << (bit % 8));
+        });
+    }
+    return filter;
+}
+
+void ChangedPaths::append(const std::string& objectsDir, const std::string& commitId, const std::string& content,
+                          const Manifest& parentFiles) {
+    Commit commit = Commit::parse(commitId, content);
+    Manifest files = Manifest::fromCommit(content);
+    std::vector<std::string_view> changed;
+    Manifest::Join join({&parentFiles, &files});
+    while (join.next() && changed.size() <= MAX_CHANGED_PATHS) {
+        if (!join.has(0) || !join.has(1) || join.blobId(0) != join.blobId(1)) {
+            changed.push_back(join.name());
+        }
+    }
+
+    std::string line = commitId + " " + std::to_string(commit.timestamp) + " ";
+    for (size_t i = 0; i < commit.parents.size(); ++i) {
+        line += (i ? "," : "") + commit.parents[i];
+    }
+    if (commit.parents.empty()) {
+        line += "-";
+    }
+    line += " ";
+    if (changed.size() > MAX_CHANGED_PATHS) {
+        line += "-";
+    } else {
+        for (unsigned char byte : buildFilter(changed)) {
+            line += HEX[byte >> 4];
+            line += HEX[byte & 15];
+        }
+    }
+    line += "\n";
+
+    std::string path = objectsDir + SIDECAR;
+    Utils::createDirectories(objectsDir + "/info");
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd >= 0) {
+        // A missing line only costs speed, so a failed write is not an error
+        ssize_t written = ::write(fd, line.data(), line.size());
+        (void)written;
+        close(fd);
+    }
+}
+
+void ChangedPaths::append(const std::string& objectsDir, const std::string& commitId, const std::string& content,
+                          const ObjectStore& parentStore) {
+    Commit commit = Commit::parse(commitId, content);
+    std::string parentContent;
+    if (!commit.parents.empty() && parentStore.read(commit.parents[0], parentContent)) {
+        append(objectsDir, commitId, content, Manifest::fromCommit(std::move(parentContent)));
+    } else {
+        append(objectsDir, commitId, content, Manifest());
+    }
+}
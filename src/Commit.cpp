@@ -0,0 +1,75 @@
+#include "../include/Commit.h"
+#include "../include/GitliteException.h"
+#include "../include/ObjectStore.h"
+#include "../include/Utils.h"
+#include <unordered_map>
+
+Commit Commit::parse(const std::string& id, const std::string& content) {
+    if (content.compare(0, 7, "parent ") != 0) {
+        throw GitliteException("No commit with that id exists.");
+    }
+
+    Commit commit;
+    commit.id = id;
+
+    size_t end = content.find('\n');
+    std::istringstream iss(content.substr(7, end - 7));
+    std::string parent;
+    while (iss >> parent) {
+        commit.parents.push_back(parent);
+    }
+
+    size_t pos = content.find("\ntimestamp ");
+    if (pos != std::string::npos) {
+        size_t lineEnd = content.find('\n', pos + 1);
+        commit.timestamp = std::stoll(content.substr(pos + 11, lineEnd - pos - 11));
+    }
+
+    pos = content.find("\nmessage ");
+    if (pos != std::string::npos) {
+        size_t lineEnd = content.find('\n', pos + 1);
+        commit.message = content.substr(pos + 9, lineEnd - pos - 9);
+    }
+    return commit;
+}
+
+Commit Commit::read(const std::string& id) {
+    ObjectStore store;
+    if (id.empty() || !store.contains(id)) {
+        throw GitliteException("No commit with that id exists.");
+    }
+    return parse(id, store.read(id));
+}
+
+/**
+ * Local-time offsets are whole quarter hours and change only on quarter-hour
+ * boundaries, so the broken-down time of each quarter hour is computed once
+ * and the minutes and seconds are added to it.
+ */
+std::string Commit::formatDate(std::time_t time) {
+    static thread_local std::unordered_map<std::time_t, std::tm> quarterHours;
+    const std::time_t quarter = 15 * 60;
+    std::time_t start = time - ((time % quarter) + quarter) % quarter;
+
+    auto cached = quarterHours.find(start);
+    if (cached == quarterHours.end()) {
+        if (quarterHours.size() >= 4096) {
+            quarterHours.clear();
+        }
+        std::tm tm;
+        localtime_r(&start, &tm);
+        cached = quarterHours.emplace(start, tm).first;
+    }
+
+    std::tm tm = cached->second;
+    if (tm.tm_sec == 0 && tm.tm_min % 15 == 0) {
+        tm.tm_min += static_cast<int>((time - start) / 60);
+        tm.tm_sec += static_cast<int>((time - start) % 60);
+    } else {
+        localtime_r(&time, &tm); // an offset that is not a whole quarter hour
+    }
+
+    char buffer[64];
+    size_t length = std::strftime(buffer, sizeof(buffer), "%a %b %d %H:%M:%S %Y %z", &tm);
+    return std::string(buffer, length);
+}
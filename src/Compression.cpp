@@ -0,0 +1,275 @@
+#include "../include/Compression.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+const size_t MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;  // the block always ends with this many literals
+const size_t MATCH_LIMIT = 12;   // no match may start within this many bytes of the end
+const size_t MAX_OFFSET = 65535;
+const int MAX_HASH_BITS = 16;
+const int MIN_HASH_BITS = 8;
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash4(uint32_t sequence, int bits) {
+    return (sequence * 2654435761U) >> (32 - bits);
+}
+
+/** Writes the extra bytes of a length field whose nibble saturated at 15. */
+inline unsigned char* writeLength(unsigned char* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<unsigned char>(length);
+    return op;
+}
+
+/** Emits one sequence: LITERALS literal bytes at ANCHOR, then a match of
+ *  MATCHLENGTH bytes OFFSET back (MATCHLENGTH 0 for the final literals). */
+unsigned char* writeSequence(unsigned char* op, const unsigned char* anchor, size_t literals,
+                             size_t offset, size_t matchLength) {
+    unsigned char* token = op++;
+    *token = static_cast<unsigned char>(std::min<size_t>(literals, 15) << 4);
+    if (literals >= 15) {
+        op = writeLength(op, literals - 15);
+    }
+    std::memcpy(op, anchor, literals);
+    op += literals;
+    if (matchLength == 0) {
+        return op;
+    }
+    *op++ = static_cast<unsigned char>(offset & 0xFF);
+    *op++ = static_cast<unsigned char>(offset >> 8);
+    size_t code = matchLength - MIN_MATCH;
+    *token |= static_cast<unsigned char>(std::min<size_t>(code, 15));
+    if (code >= 15) {
+        op = writeLength(op, code - 15);
+    }
+    return op;
+}
+
+/** Reads the extra bytes of a saturated length field; false on overrun. */
+inline bool readLength(const unsigned char*& ip, const unsigned char* end, size_t& length) {
+    unsigned char byte;
+    do {
+        if (ip >= end) {
+            return false;
+        }
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+} // namespace
+
+const int Compression::MAX_LEVEL;
+
+size_t Compression::compressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t Compression::compress(const char* source, size_t size, char* destination, int level) {
+    const auto* src = reinterpret_cast<const unsigned char*>(source);
+    auto* dst = reinterpret_cast<unsigned char*>(destination);
+    unsigned char* op = dst;
+    size_t anchor = 0;
+
+    if (size > MATCH_LIMIT) {
+        level = std::max(1, std::min(level, MAX_LEVEL));
+        const size_t attempts = size_t(1) << (level - 1);
+        const size_t matchStartLimit = size - MATCH_LIMIT;
+        const size_t matchEndLimit = size - LAST_LITERALS;
+
+        // Small inputs get a small table, which keeps them cheap to set up
+        int hashBits = MIN_HASH_BITS;
+        while (hashBits < MAX_HASH_BITS && (size_t(1) << hashBits) < size) {
+            ++hashBits;
+        }
+        // head[h]: last position + 1 with hash h; chain[i]: previous position + 1 with i's hash
+        std::vector<uint32_t> head(size_t(1) << hashBits, 0);
+        std::vector<uint32_t> chain(level > 1 ? size : 0, 0);
+        auto insert = [&](size_t position) {
+            uint32_t h = hash4(read32(src + position), hashBits);
+            if (level > 1) {
+                chain[position] = head[h];
+            }
+            head[h] = static_cast<uint32_t>(position + 1);
+        };
+
+        size_t i = 0;
+        size_t misses = 0;
+        while (i < matchStartLimit) {
+            uint32_t sequence = read32(src + i);
+            size_t bestLength = 0;
+            size_t bestPosition = 0;
+            uint32_t candidate = head[hash4(sequence, hashBits)];
+            for (size_t tries = 0; candidate != 0 && tries < attempts; ++tries) {
+                size_t position = candidate - 1;
+                if (i - position > MAX_OFFSET) {
+                    break;
+                }
+                if (read32(src + position) == sequence) {
+                    size_t length = MIN_MATCH;
+                    while (i + length < matchEndLimit && src[position + length] == src[i + length]) {
+                        ++length;
+                    }
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestPosition = position;
+                    }
+                }
+                candidate = level > 1 ? chain[position] : 0;
+            }
+            insert(i);
+
+            if (bestLength < MIN_MATCH) {
+                // Skip ahead faster through data that does not compress
+                i += 1 + (level == 1 ? (misses++ >> 6) : 0);
+                continue;
+            }
+            misses = 0;
+
+            // Grow the match backwards over pending literals
+            while (i > anchor && bestPosition > 0 && src[i - 1] == src[bestPosition - 1]) {
+                --i;
+                --bestPosition;
+                ++bestLength;
+            }
+
+            op = writeSequence(op, src + anchor, i - anchor, i - bestPosition, bestLength);
+            size_t end = i + bestLength;
+            if (level > 1) {
+                for (size_t p = i + 1; p < end && p < matchStartLimit; ++p) {
+                    insert(p);
+                }
+            } else if (end - 2 < matchStartLimit) {
+                insert(end - 2);
+            }
+            i = end;
+            anchor = end;
+        }
+    }
+
+    op = writeSequence(op, src + anchor, size - anchor, 0, 0);
+    return static_cast<size_t>(op - dst);
+}
+
+bool Compression::decompress(const char* source, size_t size, char* destination, size_t rawSize) {
+    const auto* ip = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* const inputEnd = ip + size;
+    auto* op = reinterpret_cast<unsigned char*>(destination);
+    unsigned char* const outputStart = op;
+    unsigned char* const outputEnd = op + rawSize;
+
+    while (ip < inputEnd) {
+        unsigned char token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(ip, inputEnd, literals)) {
+            return false;
+        }
+        if (literals > static_cast<size_t>(inputEnd - ip) || literals > static_cast<size_t>(outputEnd - op)) {
+            return false;
+        }
+        if (literals <= 16 && inputEnd - ip >= 16 && outputEnd - op >= 16) {
+            std::memcpy(op, ip, 16); // fixed-size copy; the excess is overwritten next
+        } else {
+            std::memcpy(op, ip, literals);
+        }
+        ip += literals;
+        op += literals;
+        if (ip == inputEnd) {
+            break; // the final sequence has no match
+        }
+
+        if (inputEnd - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, inputEnd, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - outputStart) ||
+            matchLength > static_cast<size_t>(outputEnd - op)) {
+            return false;
+        }
+
+        const unsigned char* match = op - offset;
+        unsigned char* matchEnd = op + matchLength;
+        if (offset >= 8 && outputEnd - matchEnd >= 8) {
+            // 8 bytes at a time, possibly past matchEnd (still inside the
+            // output); with offset >= 8 each step only reads finished bytes
+            do {
+                std::memcpy(op, match, 8);
+                op += 8;
+                match += 8;
+            } while (op < matchEnd);
+            op = matchEnd;
+        } else if (offset >= matchLength) {
+            std::memcpy(op, match, matchLength);
+            op = matchEnd;
+        } else {
+            while (op < matchEnd) { // overlapping: repeats the pattern
+                *op++ = *match++;
+            }
+        }
+    }
+    return op == outputEnd;
+}
+
+bool Compression::decompressPrefix(const char* source, size_t size, char* destination, size_t length) {
+    const auto* ip = reinterpret_cast<const unsigned char*>(source);
+    const unsigned char* const inputEnd = ip + size;
+    auto* op = reinterpret_cast<unsigned char*>(destination);
+    unsigned char* const outputStart = op;
+    unsigned char* const outputEnd = op + length;
+
+    // The plain byte loops stop exactly at LENGTH; only a few bytes are wanted
+    while (op < outputEnd && ip < inputEnd) {
+        unsigned char token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15 && !readLength(ip, inputEnd, literals)) {
+            return false;
+        }
+        for (; literals > 0 && op < outputEnd; --literals) {
+            if (ip == inputEnd) {
+                return false;
+            }
+            *op++ = *ip++;
+        }
+        if (op == outputEnd || ip == inputEnd) {
+            break;
+        }
+
+        if (inputEnd - ip < 2) {
+            return false;
+        }
+        size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, inputEnd, matchLength)) {
+            return false;
+        }
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - outputStart)) {
+            return false;
+        }
+        const unsigned char* match = op - offset;
+        for (; matchLength > 0 && op < outputEnd; --matchLength) {
+            *op++ = *match++;
+        }
+    }
+    return op == outputEnd;
+}
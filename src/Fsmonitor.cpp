@@ -0,0 +1,413 @@
+#include "../include/Fsmonitor.h"
+#include "../include/GitliteException.h"
+#include "../include/Trace.h"
+#include "../include/Utils.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sstream>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+const char* const SOCKET_PATH = ".gitlite/fsmonitor.sock";
+const char* const CACHE_PATH = ".gitlite/fsmonitor-cache";
+const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+// Past this many distinct names the journal is dropped as if the queue had overflowed
+const size_t JOURNAL_LIMIT = 1 << 20;
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) {
+    stopRequested = 1;
+}
+
+sockaddr_un socketAddress() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, SOCKET_PATH, sizeof(address.sun_path) - 1);
+    return address;
+}
+
+void setTimeouts(int fd) {
+    timeval timeout{2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/** Connects to the daemon of the repository in the current directory;
+ *  returns -1 if none is listening. */
+int connectToDaemon() {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    sockaddr_un address = socketAddress();
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    setTimeouts(fd);
+    return fd;
+}
+
+/** Sends REQUEST to the daemon and reads its whole reply into REPLY. */
+bool exchange(const std::string& request, std::string& reply) {
+    int fd = connectToDaemon();
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = writeAll(fd, request);
+    reply.clear();
+    char buffer[4096];
+    ssize_t n = 0;
+    while (ok && (n = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ok = false;
+            break;
+        }
+        reply.append(buffer, static_cast<size_t>(n));
+    }
+    close(fd);
+    return ok;
+}
+
+/** Matches what Utils::plainFilenamesIn lists: regular files, not symlinks. */
+bool isPlainFile(const std::string& name) {
+    Trace::count(Trace::STAT_CALLS);
+    struct stat st;
+    return lstat(name.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/** The daemon's state: the journal of changed names and the sockets. */
+class Daemon {
+public:
+    Daemon(int inotifyFd, int listenFd) : inotifyFd(inotifyFd), listenFd(listenFd) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        instance = std::to_string(getpid()) + "." + std::to_string(now);
+    }
+
+    void run() {
+        pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {listenFd, POLLIN, 0}};
+        while (!done && !stopRequested) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[0].revents != 0) {
+                drainEvents();
+            }
+            if (fds[1].revents & POLLIN) {
+                int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (client >= 0) {
+                    setTimeouts(client);
+                    serve(client);
+                    close(client);
+                }
+            }
+        }
+    }
+
+private:
+    /** Journals every event queued so far.  Events are queued when the change
+     *  happens, so after this the journal covers all completed changes. */
+    void drainEvents() {
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (true) {
+            ssize_t n = read(inotifyFd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return;
+            }
+            for (char* p = buffer; p < buffer + n;) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                p += sizeof(inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    forget();
+                } else if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                    done = true;
+                } else if (event->len > 0) {
+                    std::string name = event->name;
+                    if (name == ".gitlite") {
+                        // The repository itself went away
+                        done = done || !Utils::isDirectory(".gitlite");
+                        continue;
+                    }
+                    journal[name] = ++sequence;
+                    if (journal.size() > JOURNAL_LIMIT) {
+                        forget();
+                    }
+                }
+            }
+        }
+    }
+
+    /** Drops the journal; tokens from before now can no longer be answered. */
+    void forget() {
+        journal.clear();
+        resetAt = ++sequence;
+    }
+
+    void serve(int client) {
+        std::string request;
+        char c;
+        while (request.size() < 4096 && read(client, &c, 1) == 1 && c != '\n') {
+            request += c;
+        }
+
+        if (request == "stop") {
+            done = true;
+            writeAll(client, "ok\n");
+            return;
+        }
+        if (request.compare(0, 8, "changed ") != 0) {
+            return;
+        }
+        drainEvents();
+
+        std::string token = request.substr(8);
+        std::string reply = instance + ":" + std::to_string(sequence) + "\n";
+        size_t colon = token.rfind(':');
+        uint64_t since = 0;
+        bool known = colon != std::string::npos && token.compare(0, colon, instance) == 0;
+        if (known) {
+            char* end = nullptr;
+            since = std::strtoull(token.c_str() + colon + 1, &end, 10);
+            known = *end == '\0' && since >= resetAt && since <= sequence;
+        }
+        if (!known) {
+            reply += "*\n";
+        } else {
+            reply += "=\n";
+            for (const auto& entry : journal) {
+                if (entry.second > since) {
+                    reply += entry.first + "\n";
+                }
+            }
+        }
+        writeAll(client, reply);
+    }
+
+    int inotifyFd;
+    int listenFd;
+    std::string instance;
+    uint64_t sequence = 0;
+    uint64_t resetAt = 0;
+    std::unordered_map<std::string, uint64_t> journal;
+    bool done = false;
+};
+} // namespace
+
+void Fsmonitor::start(bool foreground) {
+    int probe = connectToDaemon();
+    if (probe >= 0) {
+        close(probe);
+        throw GitliteException("An fsmonitor daemon is already running.");
+    }
+
+    // Watch before listening, so no change is missed once clients can connect
+    int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, ".", WATCH_MASK) < 0) {
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+        throw GitliteException("Cannot watch the working directory.");
+    }
+    unlink(SOCKET_PATH); // left behind by a daemon that was killed
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_un address = socketAddress();
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listenFd, 16) != 0) {
+        close(inotifyFd);
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+        throw GitliteException("Cannot create the fsmonitor socket.");
+    }
+
+    if (!foreground) {
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(inotifyFd);
+            close(listenFd);
+            unlink(SOCKET_PATH);
+            throw GitliteException("Cannot start the fsmonitor daemon.");
+        }
+        if (pid > 0) {
+            close(inotifyFd);
+            close(listenFd);
+            return;
+        }
+        setsid();
+        int devNull = open("/dev/null", O_RDWR);
+        if (devNull >= 0) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+            if (devNull > STDERR_FILENO) {
+                close(devNull);
+            }
+        }
+    }
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGHUP, &action, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Daemon(inotifyFd, listenFd).run();
+
+    close(listenFd);
+    close(inotifyFd);
+    unlink(SOCKET_PATH);
+    if (!foreground) {
+        _exit(0);
+    }
+}
+
+bool Fsmonitor::stop() {
+    std::string reply;
+    return exchange("stop\n", reply) && reply == "ok\n";
+}
+
+bool Fsmonitor::changedSince(const std::string& token, std::string& newToken,
+                             std::set<std::string>& changed) {
+    Trace::Region region("fsmonitor.query");
+    newToken.clear();
+    changed.clear();
+    std::string reply;
+    if (!exchange("changed " + (token.empty() ? "-" : token) + "\n", reply)) {
+        return false;
+    }
+    size_t lineEnd = reply.find('\n');
+    if (lineEnd == std::string::npos) {
+        return false;
+    }
+    newToken = reply.substr(0, lineEnd);
+    if (reply.compare(lineEnd + 1, 2, "=\n") != 0) {
+        return false;
+    }
+    std::istringstream names(reply.substr(lineEnd + 3));
+    std::string name;
+    while (std::getline(names, name)) {
+        changed.insert(name);
+    }
+    return true;
+}
+
+void WorktreeSnapshot::load() {
+    std::string savedToken;
+    std::map<std::string, std::string> saved;
+    if (Utils::isFile(CACHE_PATH)) {
+        std::istringstream cache(Utils::readContentsAsString(CACHE_PATH));
+        std::getline(cache, savedToken);
+        std::string line;
+        while (std::getline(cache, line)) {
+            // "<blob id or -> <name>"
+            size_t space = line.find(' ');
+            if (space != std::string::npos) {
+                saved[line.substr(space + 1)] = line.substr(0, space);
+            }
+        }
+    }
+
+    std::set<std::string> changed;
+    bool incremental = Fsmonitor::changedSince(savedToken, token, changed) && !savedToken.empty();
+    fileSet.clear();
+    hashes.clear();
+    if (incremental) {
+        for (const auto& entry : saved) {
+            fileSet.insert(entry.first);
+            if (entry.second != "-") {
+                hashes.insert(entry);
+            }
+        }
+        for (const auto& name : changed) {
+            hashes.erase(name);
+            if (isPlainFile(name)) {
+                fileSet.insert(name);
+            } else {
+                fileSet.erase(name);
+            }
+        }
+        dirty = !changed.empty();
+    } else {
+        for (const auto& file : Utils::plainFilenamesIn(".")) {
+            fileSet.insert(file);
+        }
+        dirty = monitored();
+    }
+}
+
+void WorktreeSnapshot::save() {
+    if (!monitored() || !dirty) {
+        return;
+    }
+    std::string content = token + "\n";
+    for (const auto& file : fileSet) {
+        auto known = hashes.find(file);
+        content += (known == hashes.end() ? "-" : known->second) + " " + file + "\n";
+    }
+    std::string tempPath = std::string(CACHE_PATH) + ".tmp";
+    Utils::writeContents(tempPath, content);
+    std::rename(tempPath.c_str(), CACHE_PATH);
+    dirty = false;
+}
+
+std::string WorktreeSnapshot::hash(const std::string& file) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto known = hashes.find(file);
+        if (known != hashes.end()) {
+            Trace::count(Trace::CACHE_HITS);
+            return known->second;
+        }
+    }
+    Trace::count(Trace::CACHE_MISSES);
+    SHA1::SHA hasher; // the shared SHA1::sha instance is not thread-safe
+    std::string blobId = hasher.sha(Utils::readContentsAsString(file));
+    if (monitored()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        hashes[file] = blobId;
+        dirty = true;
+    }
+    return blobId;
+}
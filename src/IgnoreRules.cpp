@@ -0,0 +1,251 @@
+#include "../include/IgnoreRules.h"
+#include "../include/Utils.h"
+#include <sstream>
+
+const char* const IgnoreRules::FILE_NAME = ".gitliteignore";
+
+namespace {
+const std::string WILDCARDS = "*?[\\";
+
+/** Matches the bracket expression at PATTERN[P] ("[" already seen at P)
+ *  against C.  Sets P past the closing "]"; returns false, leaving P, if the
+ *  expression is unterminated, in which case "[" is an ordinary character. */
+bool matchClass(std::string_view pattern, size_t& p, char c, bool& matched) {
+    size_t i = p + 1;
+    bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negated) {
+        ++i;
+    }
+    bool found = false;
+    bool first = true;
+    while (i < pattern.size() && (pattern[i] != ']' || first)) {
+        first = false;
+        char low = pattern[i];
+        if (low == '\\' && i + 1 < pattern.size()) {
+            low = pattern[++i];
+        }
+        char high = low;
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            high = pattern[i + 2];
+            if (high == '\\' && i + 3 < pattern.size()) {
+                ++i;
+                high = pattern[i + 2];
+            }
+            i += 2;
+        }
+        if (low <= c && c <= high) {
+            found = true;
+        }
+        ++i;
+    }
+    if (i >= pattern.size()) {
+        return false;
+    }
+    p = i + 1;
+    matched = found != negated && c != '/';
+    return true;
+}
+
+/** Matches glob PATTERN against TEXT, gitignore style. */
+bool globMatch(std::string_view pattern, std::string_view text) {
+    size_t p = 0;
+    size_t t = 0;
+    while (p < pattern.size()) {
+        char c = pattern[p];
+        if (c == '*') {
+            size_t stars = p;
+            while (p < pattern.size() && pattern[p] == '*') {
+                ++p;
+            }
+            bool atComponentStart = stars == 0 || pattern[stars - 1] == '/';
+            if (p - stars >= 2 && atComponentStart && (p == pattern.size() || pattern[p] == '/')) {
+                if (p == pattern.size()) {
+                    return true; // "x/**": everything inside
+                }
+                // "**/": zero or more whole directories
+                std::string_view rest = pattern.substr(p + 1);
+                if (globMatch(rest, text.substr(t))) {
+                    return true;
+                }
+                for (size_t i = t; i < text.size(); ++i) {
+                    if (text[i] == '/' && globMatch(rest, text.substr(i + 1))) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            // Any other run of stars is one "*": anything but "/"
+            std::string_view rest = pattern.substr(p);
+            if (rest.empty()) {
+                return text.find('/', t) == std::string_view::npos;
+            }
+            for (size_t i = t;; ++i) {
+                if (globMatch(rest, text.substr(i))) {
+                    return true;
+                }
+                if (i >= text.size() || text[i] == '/') {
+                    return false;
+                }
+            }
+        }
+        if (t >= text.size()) {
+            return false;
+        }
+        if (c == '?') {
+            if (text[t] == '/') {
+                return false;
+            }
+            ++p;
+            ++t;
+            continue;
+        }
+        if (c == '[') {
+            bool matched;
+            if (matchClass(pattern, p, text[t], matched)) {
+                if (!matched) {
+                    return false;
+                }
+                ++t;
+                continue;
+            }
+        }
+        if (c == '\\' && p + 1 < pattern.size()) {
+            c = pattern[++p];
+        }
+        if (c != text[t]) {
+            return false;
+        }
+        ++p;
+        ++t;
+    }
+    return t == text.size();
+}
+
+/** Removes backslash escapes from a pattern with no wildcards. */
+std::string unescape(std::string_view pattern) {
+    std::string literal;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] == '\\' && i + 1 < pattern.size()) {
+            ++i;
+        }
+        literal += pattern[i];
+    }
+    return literal;
+}
+
+bool hasWildcards(std::string_view pattern) {
+    return pattern.find_first_of(WILDCARDS) != std::string_view::npos;
+}
+} // namespace
+
+IgnoreRules IgnoreRules::load() {
+    if (!Utils::isFile(FILE_NAME)) {
+        return IgnoreRules();
+    }
+    return parse(Utils::readContentsAsString(FILE_NAME));
+}
+
+IgnoreRules IgnoreRules::parse(const std::string& text) {
+    IgnoreRules compiled;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        // Trailing spaces are dropped unless escaped
+        size_t end = line.size();
+        while (end > 0 && line[end - 1] == ' ' && !(end > 1 && line[end - 2] == '\\')) {
+            --end;
+        }
+        std::string_view pattern(line.data(), end);
+        if (pattern.empty() || pattern[0] == '#') {
+            continue;
+        }
+
+        Rule rule{GLOB, "", false, false, false};
+        if (pattern[0] == '!') {
+            rule.negated = true;
+            pattern.remove_prefix(1);
+        } else if (pattern[0] == '\\' && pattern.size() > 1 && (pattern[1] == '!' || pattern[1] == '#')) {
+            pattern.remove_prefix(1);
+        }
+        if (!pattern.empty() && pattern.back() == '/') {
+            rule.directoryOnly = true;
+            pattern.remove_suffix(1);
+        }
+        rule.anchored = pattern.find('/') != std::string_view::npos;
+        if (!pattern.empty() && pattern[0] == '/') {
+            pattern.remove_prefix(1);
+        }
+        if (pattern.empty()) {
+            continue;
+        }
+
+        // Pick the cheapest test that implements the pattern
+        std::string_view body = pattern;
+        if (!hasWildcards(body)) {
+            rule.kind = EXACT;
+            rule.pattern = unescape(body);
+        } else if (body[0] == '*' && body.size() > 1 && !hasWildcards(body.substr(1))) {
+            rule.kind = SUFFIX;
+            rule.pattern = unescape(body.substr(1));
+        } else if (body.back() == '*' && body.size() > 1 && !hasWildcards(body.substr(0, body.size() - 1))) {
+            rule.kind = PREFIX;
+            rule.pattern = unescape(body.substr(0, body.size() - 1));
+        } else {
+            rule.pattern = std::string(body);
+        }
+        if (rule.kind != GLOB && rule.kind != EXACT && rule.pattern.find('/') != std::string::npos) {
+            rule.kind = GLOB; // "*" must not cross the "/"
+            rule.pattern = std::string(body);
+        }
+        compiled.rules.push_back(std::move(rule));
+    }
+    return compiled;
+}
+
+bool IgnoreRules::ignored(std::string_view path, bool isDirectory) const {
+    if (rules.empty()) {
+        return false;
+    }
+    // A file in an excluded directory cannot be re-included
+    for (size_t slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+        if (excluded(path.substr(0, slash), true)) {
+            return true;
+        }
+    }
+    return excluded(path, isDirectory);
+}
+
+bool IgnoreRules::excluded(std::string_view path, bool isDirectory) const {
+    size_t slash = path.rfind('/');
+    std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+    for (auto rule = rules.rbegin(); rule != rules.rend(); ++rule) {
+        if (rule->directoryOnly && !isDirectory) {
+            continue;
+        }
+        if (matches(*rule, rule->anchored ? path : name)) {
+            return !rule->negated;
+        }
+    }
+    return false;
+}
+
+bool IgnoreRules::matches(const Rule& rule, std::string_view text) {
+    const std::string& pattern = rule.pattern;
+    switch (rule.kind) {
+    case EXACT:
+        return text == pattern;
+    case SUFFIX:
+        return text.size() >= pattern.size() &&
+               text.compare(text.size() - pattern.size(), pattern.size(), pattern) == 0 &&
+               text.find('/') == std::string_view::npos;
+    case PREFIX:
+        return text.size() >= pattern.size() && text.compare(0, pattern.size(), pattern) == 0 &&
+               text.find('/', pattern.size()) == std::string_view::npos;
+    case GLOB:
+        break;
+    }
+    return globMatch(pattern, text);
+}
@@ -0,0 +1,139 @@
+#include "../include/LineDiff.h"
+#include <unordered_map>
+
+const size_t LineDiff::NONE;
+
+namespace {
+/** Myers' diff of A and B, interned lines, recording matches in MATCHES
+ *  (indexed by B). */
+class Differ {
+public:
+    Differ(const std::vector<int>& a, const std::vector<int>& b, std::vector<size_t>& matches)
+        : a(a), b(b), matches(matches) {}
+
+    /** Diffs A[ALOW, AHIGH) against B[BLOW, BHIGH). */
+    void diff(long aLow, long aHigh, long bLow, long bHigh) {
+        while (aLow < aHigh && bLow < bHigh && a[aLow] == b[bLow]) {
+            matches[bLow++] = static_cast<size_t>(aLow++);
+        }
+        while (aLow < aHigh && bLow < bHigh && a[aHigh - 1] == b[bHigh - 1]) {
+            matches[--bHigh] = static_cast<size_t>(--aHigh);
+        }
+        if (aLow == aHigh || bLow == bHigh) {
+            return;
+        }
+        long x, y;
+        if (split(aLow, aHigh, bLow, bHigh, x, y)) {
+            diff(aLow, aLow + x, bLow, bLow + y);
+            diff(aLow + x, aHigh, bLow + y, bHigh);
+        }
+    }
+
+private:
+    /** Finds a point (X, Y), relative to the range starts, on a shortest
+     *  edit path through the given ranges by running the search from both
+     *  ends until the two meet.  Returns false if the ranges have no line
+     *  in common. */
+    bool split(long aLow, long aHigh, long bLow, long bHigh, long& x, long& y) {
+        long n = aHigh - aLow;
+        long m = bHigh - bLow;
+        long maxD = (n + m + 1) / 2;
+        long offset = maxD;
+        // FORWARD[offset + k]: furthest x reached on diagonal k = x - y from
+        // the start; BACKWARD likewise from the end, on the reversed ranges
+        std::vector<long> forward(2 * maxD + 2, -1);
+        std::vector<long> backward(2 * maxD + 2, -1);
+        forward[offset + 1] = 0;
+        backward[offset + 1] = 0;
+        long delta = n - m;
+        bool odd = delta % 2 != 0;
+        // Diagonals that ran off an edge are not extended any further
+        long forwardStart = 0, forwardEnd = 0, backwardStart = 0, backwardEnd = 0;
+        for (long d = 0; d < maxD; ++d) {
+            for (long k = -d + forwardStart; k <= d - forwardEnd; k += 2) {
+                long i = offset + k;
+                long x1 = k == -d || (k != d && forward[i - 1] < forward[i + 1]) ? forward[i + 1] : forward[i - 1] + 1;
+                long y1 = x1 - k;
+                while (x1 < n && y1 < m && a[aLow + x1] == b[bLow + y1]) {
+                    ++x1;
+                    ++y1;
+                }
+                forward[i] = x1;
+                if (x1 > n) {
+                    forwardEnd += 2;
+                } else if (y1 > m) {
+                    forwardStart += 2;
+                } else if (odd) {
+                    long j = offset + delta - k;
+                    if (j >= 0 && j < 2 * maxD && backward[j] != -1 && x1 >= n - backward[j]) {
+                        x = x1;
+                        y = y1;
+                        return true;
+                    }
+                }
+            }
+            for (long k = -d + backwardStart; k <= d - backwardEnd; k += 2) {
+                long i = offset + k;
+                long x2 = k == -d || (k != d && backward[i - 1] < backward[i + 1]) ? backward[i + 1] : backward[i - 1] + 1;
+                long y2 = x2 - k;
+                while (x2 < n && y2 < m && a[aHigh - 1 - x2] == b[bHigh - 1 - y2]) {
+                    ++x2;
+                    ++y2;
+                }
+                backward[i] = x2;
+                if (x2 > n) {
+                    backwardEnd += 2;
+                } else if (y2 > m) {
+                    backwardStart += 2;
+                } else if (!odd) {
+                    long j = offset + delta - k;
+                    if (j >= 0 && j < 2 * maxD && forward[j] != -1 && forward[j] >= n - x2) {
+                        x = forward[j];
+                        y = forward[j] - (j - offset);
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    const std::vector<int>& a;
+    const std::vector<int>& b;
+    std::vector<size_t>& matches;
+};
+} // namespace
+
+std::vector<std::string_view> LineDiff::splitLines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+std::vector<size_t> LineDiff::match(const std::vector<std::string_view>& oldLines,
+                                    const std::vector<std::string_view>& newLines) {
+    std::unordered_map<std::string_view, int> ids;
+    ids.reserve(oldLines.size() + newLines.size());
+    auto intern = [&ids](const std::vector<std::string_view>& lines) {
+        std::vector<int> interned;
+        interned.reserve(lines.size());
+        for (const auto& line : lines) {
+            interned.push_back(ids.emplace(line, static_cast<int>(ids.size())).first->second);
+        }
+        return interned;
+    };
+    std::vector<int> a = intern(oldLines);
+    std::vector<int> b = intern(newLines);
+
+    std::vector<size_t> matches(b.size(), NONE);
+    Differ(a, b, matches).diff(0, static_cast<long>(a.size()), 0, static_cast<long>(b.size()));
+    return matches;
+}
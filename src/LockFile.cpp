@@ -0,0 +1,90 @@
+#include "../include/LockFile.h"
+#include "../include/GitliteException.h"
+#include "../include/Trace.h"
+#include "../include/Utils.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+const int LockFile::TIMEOUT_MS;
+
+LockFile::LockFile(const std::string& path) : target(path), path(path + ".lock") {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash);
+    if (!dir.empty()) {
+        Utils::createDirectories(dir);
+    }
+
+    Backoff backoff;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(TIMEOUT_MS);
+    while (true) {
+        fd = open(this->path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            held = true;
+            return;
+        }
+        if (errno == ENOENT && !dir.empty() && std::chrono::steady_clock::now() < deadline) {
+            // pack-refs removed the directory after it was created
+            Utils::createDirectories(dir);
+            continue;
+        }
+        if (errno != EEXIST || std::chrono::steady_clock::now() >= deadline) {
+            throw GitliteException("Unable to lock " + target + ": " + this->path +
+                                   " exists. If no other gitlite process is running, remove it.");
+        }
+        Trace::count(Trace::LOCK_WAITS);
+        backoff.wait();
+    }
+}
+
+LockFile::~LockFile() {
+    release();
+}
+
+void LockFile::write(const std::string& content) {
+    size_t written = 0;
+    while (written < content.size()) {
+        ssize_t n = ::write(fd, content.data() + written, content.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw GitliteException("Cannot write " + path + ".");
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+void LockFile::commit() {
+    if (!held) {
+        return;
+    }
+    close(fd);
+    fd = -1;
+    if (rename(path.c_str(), target.c_str()) != 0) {
+        release();
+        throw GitliteException("Cannot update " + target + ".");
+    }
+    held = false;
+}
+
+void LockFile::release() {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (held) {
+        unlink(path.c_str());
+        held = false;
+    }
+}
+
+Backoff::Backoff() : jitter(static_cast<unsigned>(getpid())) {}
+
+void Backoff::wait() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(delayMs / 2 + jitter() % (delayMs / 2 + 1)));
+    delayMs = std::min(delayMs * 2, 128);
+}
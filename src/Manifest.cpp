@@ -0,0 +1,128 @@
+#include "../include/Manifest.h"
+#include <algorithm>
+
+namespace {
+bool byName(const Manifest::Entry& a, const Manifest::Entry& b) {
+    return a.name < b.name;
+}
+} // namespace
+
+Manifest::Manifest() {
+    static const std::shared_ptr<const Data> none = std::make_shared<Data>();
+    data = none;
+}
+
+Manifest Manifest::fromCommit(std::string content) {
+    // Match at a line start, so that a message mentioning "files " is skipped
+    size_t begin = content.find("\nfiles ");
+    if (begin == std::string::npos) {
+        return Manifest();
+    }
+    begin += 7;
+    size_t end = std::min(content.find('\n', begin), content.size());
+    return parse(std::move(content), begin, end, false);
+}
+
+Manifest Manifest::fromEntries(const std::vector<std::pair<std::string, std::string>>& entries) {
+    std::string text;
+    for (const auto& entry : entries) {
+        text += entry.first + ":" + entry.second + ";";
+    }
+    size_t end = text.size();
+    return parse(std::move(text), 0, end, true);
+}
+
+Manifest Manifest::parse(std::string text, size_t begin, size_t end, bool keepDeletes) {
+    auto parsed = std::make_shared<Data>();
+    parsed->text = std::move(text);
+    std::string_view all(parsed->text);
+
+    size_t start = begin;
+    while (start < end) {
+        size_t colon = all.find(':', start);
+        if (colon == std::string_view::npos || colon >= end) {
+            break;
+        }
+        size_t semicolon = all.find(';', colon);
+        if (semicolon == std::string_view::npos || semicolon >= end) {
+            break;
+        }
+        ObjectId blobId;
+        if (ObjectId::parse(all.substr(colon + 1, semicolon - colon - 1), blobId) || keepDeletes) {
+            parsed->entries.push_back({all.substr(start, colon - start), blobId});
+        }
+        start = semicolon + 1;
+    }
+
+    // Commits list their files in order, so this is normally a single check
+    auto& entries = parsed->entries;
+    if (std::adjacent_find(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+            return !(a.name < b.name);
+        }) != entries.end()) {
+        std::stable_sort(entries.begin(), entries.end(), byName);
+        // Keep the last of equal names
+        std::vector<Entry> unique;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i + 1 == entries.size() || entries[i].name != entries[i + 1].name) {
+                unique.push_back(entries[i]);
+            }
+        }
+        entries.swap(unique);
+    }
+    return Manifest(std::move(parsed));
+}
+
+const Manifest::Entry* Manifest::find(std::string_view name) const {
+    auto it = std::lower_bound(begin(), end(), Entry{name, {}}, byName);
+    return it != end() && it->name == name ? &*it : nullptr;
+}
+
+ObjectId Manifest::blobId(std::string_view name) const {
+    const Entry* entry = find(name);
+    return entry ? entry->blobId : ObjectId();
+}
+
+std::string Manifest::serialize() const {
+    std::string text;
+    for (const auto& entry : *this) {
+        text.append(entry.name).append(1, ':');
+        entry.blobId.appendHex(text);
+        text.append(1, ';');
+    }
+    return text;
+}
+
+std::map<std::string, std::string> Manifest::toMap() const {
+    std::map<std::string, std::string> files;
+    for (const auto& entry : *this) {
+        files.emplace_hint(files.end(), std::string(entry.name), entry.blobId.hex());
+    }
+    return files;
+}
+
+Manifest::Join::Join(std::initializer_list<const Manifest*> manifests)
+    : manifests(manifests), present(manifests.size(), false) {
+    for (const Manifest* manifest : manifests) {
+        positions.push_back(manifest->begin());
+    }
+}
+
+bool Manifest::Join::next() {
+    bool found = false;
+    for (size_t i = 0; i < manifests.size(); ++i) {
+        if (positions[i] != manifests[i]->end() && (!found || positions[i]->name < current)) {
+            current = positions[i]->name;
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    for (size_t i = 0; i < manifests.size(); ++i) {
+        present[i] = positions[i] != manifests[i]->end() && positions[i]->name == current;
+        if (present[i]) {
+            ++positions[i];
+        }
+    }
+    return true;
+}
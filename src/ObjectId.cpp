@@ -0,0 +1,65 @@
+#include "../include/ObjectId.h"
+
+namespace {
+const char HEX_DIGITS[] = "0123456789abcdef";
+
+/** Hex digit values by character; 0xFF for anything that is not a digit.
+ *  Upper-case digits are accepted. */
+struct DigitTable {
+    unsigned char values[256];
+    DigitTable() {
+        std::memset(values, 0xFF, sizeof(values));
+        for (int i = 0; i < 10; ++i) {
+            values['0' + i] = static_cast<unsigned char>(i);
+        }
+        for (int i = 0; i < 6; ++i) {
+            values['a' + i] = values['A' + i] = static_cast<unsigned char>(10 + i);
+        }
+    }
+};
+const DigitTable DIGITS;
+} // namespace
+
+const size_t ObjectId::SIZE;
+const size_t ObjectId::HEX_SIZE;
+
+bool ObjectId::parse(std::string_view hex, ObjectId& id) {
+    if (hex.size() != HEX_SIZE) {
+        return false;
+    }
+    // Check validity once at the end: a bad digit sets the 0x80 bit
+    ObjectId parsed;
+    unsigned char invalid = 0;
+    for (size_t i = 0; i < SIZE; ++i) {
+        unsigned char high = DIGITS.values[static_cast<unsigned char>(hex[2 * i])];
+        unsigned char low = DIGITS.values[static_cast<unsigned char>(hex[2 * i + 1])];
+        invalid |= high | low;
+        parsed.bytes[i] = static_cast<unsigned char>(high << 4 | (low & 15));
+    }
+    if (invalid & 0x80) {
+        return false;
+    }
+    id = parsed;
+    return true;
+}
+
+ObjectId ObjectId::fromHex(std::string_view hex) {
+    ObjectId id;
+    parse(hex, id);
+    return id;
+}
+
+std::string ObjectId::hex() const {
+    std::string out;
+    appendHex(out);
+    return out;
+}
+
+void ObjectId::appendHex(std::string& out) const {
+    size_t start = out.size();
+    out.resize(start + HEX_SIZE);
+    for (size_t i = 0; i < SIZE; ++i) {
+        out[start + 2 * i] = HEX_DIGITS[bytes[i] >> 4];
+        out[start + 2 * i + 1] = HEX_DIGITS[bytes[i] & 15];
+    }
+}
@@ -0,0 +1,522 @@
+#include "../include/ObjectStore.h"
+#include "../include/Compression.h"
+#include "../include/GitliteException.h"
+#include "../include/Trace.h"
+#include "../include/Utils.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/fs.h>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+const char CHUNK_LIST_MAGIC[] = "gitlite chunk-list\n";
+const size_t MAGIC_LENGTH = sizeof(CHUNK_LIST_MAGIC) - 1;
+
+const char FRAME_MAGIC[4] = {'\0', 'G', 'L', 'Z'};
+const size_t FRAME_HEADER = 13; // magic, method, 8-byte size
+const char METHOD_STORED = 0;
+const char METHOD_COMPRESSED = 1;
+// Compressed bytes read to decode the magic line; a literal run needs a
+// length byte per 255 bytes, so this covers any run of an unchunked blob
+const size_t PREFIX_INPUT = 4096;
+
+bool isFramed(const std::string& stored) {
+    return stored.size() >= FRAME_HEADER && std::memcmp(stored.data(), FRAME_MAGIC, 4) == 0;
+}
+
+// Normalized chunking: cuts are harder to find before the average size and
+// easier after it, which narrows the chunk size distribution.  The gear hash
+// shifts left, so its top bits depend on the last 64 bytes.
+const uint64_t MASK_HARD = 0xFFFFC00000000000ULL; // 18 bits
+const uint64_t MASK_EASY = 0xFFFC000000000000ULL; // 14 bits
+
+/** 256 fixed pseudo-random values (splitmix64), one per byte value. */
+struct GearTable {
+    uint64_t values[256];
+    GearTable() {
+        uint64_t state = 0x6769746c69746521ULL;
+        for (auto& value : values) {
+            uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            value = z ^ (z >> 31);
+        }
+    }
+};
+const GearTable GEAR;
+
+/** Returns the length of the chunk starting at DATA (N bytes remain). */
+size_t cutPoint(const unsigned char* data, size_t n) {
+    if (n <= ObjectStore::MIN_CHUNK) {
+        return n;
+    }
+    size_t normal = std::min(n, ObjectStore::AVERAGE_CHUNK);
+    size_t limit = std::min(n, ObjectStore::MAX_CHUNK);
+    uint64_t hash = 0;
+    size_t i = ObjectStore::MIN_CHUNK; // no cut can fall before MIN_CHUNK
+    for (; i < normal; ++i) {
+        hash = (hash << 1) + GEAR.values[data[i]];
+        if ((hash & MASK_HARD) == 0) {
+            return i + 1;
+        }
+    }
+    for (; i < limit; ++i) {
+        hash = (hash << 1) + GEAR.values[data[i]];
+        if ((hash & MASK_EASY) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+/** Reads the first LENGTH bytes of PATH, or less if it is shorter. */
+std::string readPrefix(const std::string& path, size_t length) {
+    std::ifstream file(path, std::ios::binary);
+    std::string prefix(length, '\0');
+    file.read(&prefix[0], static_cast<std::streamsize>(length));
+    prefix.resize(static_cast<size_t>(file.gcount()));
+    return prefix;
+}
+/** Appends to DIRS the alternates listed for objects directory OBJECTSDIR,
+ *  each followed by its own, skipping directories already in DIRS. */
+void readAlternates(const std::string& objectsDir, int depth, std::vector<std::string>& dirs) {
+    if (depth > ObjectStore::MAX_ALTERNATE_DEPTH) {
+        return;
+    }
+    std::ifstream file(objectsDir + "/info/alternates");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::string dir = line[0] == '/' ? line : objectsDir + "/" + line;
+        if (std::find(dirs.begin(), dirs.end(), dir) == dirs.end()) {
+            dirs.push_back(dir);
+            readAlternates(dir, depth + 1, dirs);
+        }
+    }
+}
+} // namespace
+
+/** The alternates of one objects directory and what is known about which of
+ *  them holds each object looked up there. */
+struct ObjectStore::Alternates {
+    static const int NOWHERE = -1;
+
+    std::vector<std::string> dirs;
+    std::mutex mutex;                           // guards holder
+    std::unordered_map<std::string, int> holder; // object ID -> index in dirs, or NOWHERE
+
+    /** The alternates of OBJECTSDIR, shared by every store on it; null if it
+     *  has none.  Costs one stat when there is no alternates file. */
+    static std::shared_ptr<Alternates> of(const std::string& objectsDir);
+};
+
+std::shared_ptr<ObjectStore::Alternates> ObjectStore::Alternates::of(const std::string& objectsDir) {
+    struct stat info;
+    if (stat((objectsDir + "/info/alternates").c_str(), &info) != 0) {
+        return nullptr;
+    }
+
+    // Keyed by the file itself, not its path: the same relative path names
+    // another repository after a chdir.  A changed file is read again.
+    struct Entry {
+        struct timespec modified;
+        off_t size;
+        std::shared_ptr<Alternates> alternates;
+    };
+    static std::mutex registryMutex;
+    static std::map<std::pair<dev_t, ino_t>, Entry> registry;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    Entry& entry = registry[{info.st_dev, info.st_ino}];
+    if (!entry.alternates || entry.size != info.st_size || entry.modified.tv_sec != info.st_mtim.tv_sec ||
+        entry.modified.tv_nsec != info.st_mtim.tv_nsec) {
+        entry.alternates = std::make_shared<Alternates>();
+        readAlternates(objectsDir, 1, entry.alternates->dirs);
+        entry.modified = info.st_mtim;
+        entry.size = info.st_size;
+    }
+    return entry.alternates->dirs.empty() ? nullptr : entry.alternates;
+}
+
+const size_t ObjectStore::CHUNKING_THRESHOLD;
+const size_t ObjectStore::MIN_CHUNK;
+const size_t ObjectStore::AVERAGE_CHUNK;
+const size_t ObjectStore::MAX_CHUNK;
+
+const int ObjectStore::MAX_ALTERNATE_DEPTH;
+const char* const ObjectStore::TEMP_PREFIX = "tmp_obj_";
+
+ObjectStore::ObjectStore(const std::string& objectsDir)
+    : objectsDir(objectsDir), alternates(Alternates::of(objectsDir)) {}
+
+std::string ObjectStore::path(const std::string& id) const {
+    return objectsDir + "/" + id;
+}
+
+bool ObjectStore::locate(const std::string& id, std::string& where) const {
+    where = path(id);
+    if (Utils::exists(where)) {
+        return true;
+    }
+    if (!alternates) {
+        return false;
+    }
+
+    int holder = Alternates::NOWHERE;
+    bool known;
+    {
+        std::lock_guard<std::mutex> lock(alternates->mutex);
+        auto cached = alternates->holder.find(id);
+        known = cached != alternates->holder.end();
+        if (known) {
+            holder = cached->second;
+        }
+    }
+    if (!known) {
+        for (size_t i = 0; i < alternates->dirs.size(); ++i) {
+            if (Utils::exists(alternates->dirs[i] + "/" + id)) {
+                holder = static_cast<int>(i);
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(alternates->mutex);
+        alternates->holder[id] = holder;
+    }
+    if (holder == Alternates::NOWHERE) {
+        return false;
+    }
+    where = alternates->dirs[holder] + "/" + id;
+    return true;
+}
+
+std::string ObjectStore::readPath(const std::string& id) const {
+    if (!alternates) {
+        return path(id); // no stat needed: reading a missing file fails anyway
+    }
+    std::string where;
+    return locate(id, where) ? where : path(id);
+}
+
+bool ObjectStore::contains(const std::string& id) const {
+    std::string where;
+    return locate(id, where);
+}
+
+std::string ObjectStore::findByPrefix(const std::string& prefix) const {
+    std::string first;
+    std::vector<std::string> dirs = {objectsDir};
+    if (alternates) {
+        dirs.insert(dirs.end(), alternates->dirs.begin(), alternates->dirs.end());
+    }
+    for (const auto& dir : dirs) {
+        for (const auto& id : Utils::plainFilenamesIn(dir)) {
+            if (id.compare(0, prefix.size(), prefix) == 0) {
+                if (first.empty() || id < first) {
+                    first = id;
+                }
+                break; // sorted: the first match is the smallest here
+            }
+        }
+    }
+    return first;
+}
+
+int ObjectStore::compressionLevel() {
+    static const int level = [] {
+        const char* value = std::getenv("GITLITE_COMPRESSION");
+        if (value == nullptr || *value == '\0') {
+            return 1;
+        }
+        return std::max(0, std::min(std::atoi(value), Compression::MAX_LEVEL));
+    }();
+    return level;
+}
+
+std::string ObjectStore::encode(const std::string& content, int level) {
+    bool looksFramed = isFramed(content);
+    if (level > 0 && !content.empty()) {
+        std::string stored(FRAME_HEADER + Compression::compressBound(content.size()), '\0');
+        size_t size = Compression::compress(content.data(), content.size(), &stored[FRAME_HEADER], level);
+        if (FRAME_HEADER + size < content.size()) {
+            std::memcpy(&stored[0], FRAME_MAGIC, 4);
+            stored[4] = METHOD_COMPRESSED;
+            uint64_t rawSize = content.size();
+            for (int i = 0; i < 8; ++i) {
+                stored[5 + i] = static_cast<char>((rawSize >> (8 * i)) & 0xFF);
+            }
+            stored.resize(FRAME_HEADER + size);
+            return stored;
+        }
+    }
+    if (!looksFramed) {
+        return content;
+    }
+    // Raw content that starts like a frame must be framed, or it would be misread
+    std::string stored(FRAME_MAGIC, 4);
+    stored += METHOD_STORED;
+    uint64_t rawSize = content.size();
+    for (int i = 0; i < 8; ++i) {
+        stored += static_cast<char>((rawSize >> (8 * i)) & 0xFF);
+    }
+    return stored + content;
+}
+
+bool ObjectStore::decode(const std::string& stored, std::string& content) {
+    if (!isFramed(stored)) {
+        content = stored; // written uncompressed
+        return true;
+    }
+    uint64_t rawSize = 0;
+    for (int i = 0; i < 8; ++i) {
+        rawSize |= static_cast<uint64_t>(static_cast<unsigned char>(stored[5 + i])) << (8 * i);
+    }
+    if (stored[4] == METHOD_STORED) {
+        content = stored.substr(FRAME_HEADER);
+        return content.size() == rawSize;
+    }
+    // Guard the allocation: the format cannot expand data more than 255 times
+    if (stored[4] != METHOD_COMPRESSED || rawSize / 255 > stored.size()) {
+        return false;
+    }
+    content.assign(rawSize, '\0');
+    return Compression::decompress(stored.data() + FRAME_HEADER, stored.size() - FRAME_HEADER,
+                                   &content[0], rawSize);
+}
+
+std::string ObjectStore::read(const std::string& id) const {
+    std::string content;
+    if (!decode(Utils::readContentsAsString(readPath(id)), content)) {
+        throw GitliteException("Object " + id + " is corrupt.");
+    }
+    return content;
+}
+
+bool ObjectStore::read(const std::string& id, std::string& content) const {
+    std::string where;
+    return locate(id, where) && decode(Utils::readContentsAsString(where), content);
+}
+
+bool ObjectStore::isTemporary(const std::string& name) {
+    return name.compare(0, std::strlen(TEMP_PREFIX), TEMP_PREFIX) == 0;
+}
+
+std::string ObjectStore::temporaryPath(const ObjectStore& store) {
+    static std::atomic<unsigned long> counter(0);
+    return store.objectsDir + "/" + TEMP_PREFIX + std::to_string(getpid()) + "_" + std::to_string(counter++);
+}
+
+void ObjectStore::install(const ObjectStore& other, const std::string& id, const std::string& stored) {
+    std::string temporary = temporaryPath(other);
+    Utils::writeContents(temporary, stored);
+    if (rename(temporary.c_str(), other.path(id).c_str()) != 0) {
+        unlink(temporary.c_str());
+        throw GitliteException("Cannot write object " + id + ".");
+    }
+}
+
+void ObjectStore::write(const std::string& id, const std::string& content) const {
+    install(*this, id, encode(content, compressionLevel()));
+}
+
+void ObjectStore::copyTo(const std::string& id, const ObjectStore& other) const {
+    install(other, id, Utils::readContentsAsString(readPath(id)));
+}
+
+void ObjectStore::linkTo(const std::string& id, const ObjectStore& other) const {
+    std::string from = readPath(id);
+    std::string to = other.path(id);
+    if (link(from.c_str(), to.c_str()) == 0 || errno == EEXIST) {
+        return;
+    }
+#ifdef FICLONE
+    // Across filesystems, or where hard links are not allowed: a reflink
+    // still shares the data blocks on copy-on-write filesystems
+    int in = open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in >= 0) {
+        std::string temporary = temporaryPath(other);
+        int out = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        bool cloned = out >= 0 && ioctl(out, FICLONE, in) == 0;
+        if (out >= 0) {
+            close(out);
+            cloned = cloned && rename(temporary.c_str(), to.c_str()) == 0;
+            if (!cloned) {
+                unlink(temporary.c_str());
+            }
+        }
+        close(in);
+        if (cloned) {
+            return;
+        }
+    }
+#endif
+    copyTo(id, other);
+}
+
+bool ObjectStore::isChunkList(const std::string& content) {
+    return content.compare(0, MAGIC_LENGTH, CHUNK_LIST_MAGIC) == 0;
+}
+
+std::vector<std::string> ObjectStore::parseChunkList(const std::string& content) {
+    std::vector<std::string> chunkIds;
+    std::istringstream lines(content.substr(MAGIC_LENGTH));
+    std::string line;
+    std::getline(lines, line); // size <total>
+    while (std::getline(lines, line)) {
+        size_t space = line.find(' ');
+        if (space != std::string::npos) {
+            chunkIds.push_back(line.substr(0, space));
+        }
+    }
+    return chunkIds;
+}
+
+std::vector<size_t> ObjectStore::chunkBoundaries(const std::string& data) {
+    std::vector<size_t> ends;
+    const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    size_t offset = 0;
+    while (offset < data.size()) {
+        offset += cutPoint(bytes + offset, data.size() - offset);
+        ends.push_back(offset);
+    }
+    return ends;
+}
+
+void ObjectStore::writeBlob(const std::string& blobId, const std::string& content) const {
+    if (contains(blobId)) {
+        // Borrowed objects live in an alternate, which gc never prunes
+        for (const auto& chunkId : chunksOf(blobId)) {
+            Utils::touch(path(chunkId));
+        }
+        Utils::touch(path(blobId));
+        return;
+    }
+    // A small blob that looks like a chunk list is chunked too, so that
+    // every object starting with the magic line really is one
+    if (content.size() < CHUNKING_THRESHOLD && !isChunkList(content)) {
+        write(blobId, content);
+        return;
+    }
+
+    Trace::Region region("chunk");
+    std::string list = CHUNK_LIST_MAGIC;
+    list += "size " + std::to_string(content.size()) + "\n";
+    size_t start = 0;
+    for (size_t end : chunkBoundaries(content)) {
+        std::string chunk = content.substr(start, end - start);
+        std::string chunkId = Utils::sha1(chunk);
+        if (contains(chunkId)) {
+            Utils::touch(path(chunkId));
+        } else {
+            write(chunkId, chunk);
+        }
+        list += chunkId + " " + std::to_string(chunk.size()) + "\n";
+        start = end;
+    }
+    write(blobId, list);
+}
+
+std::string ObjectStore::readBlob(const std::string& blobId) const {
+    std::string content = read(blobId);
+    if (!isChunkList(content)) {
+        return content;
+    }
+    std::string joined;
+    for (const auto& chunkId : parseChunkList(content)) {
+        joined += read(chunkId);
+    }
+    return joined;
+}
+
+void ObjectStore::checkoutBlob(const std::string& blobId, const std::string& filePath) const {
+    std::string content = read(blobId);
+    if (!isChunkList(content)) {
+        Utils::writeContents(filePath, content);
+        return;
+    }
+    std::ofstream file(filePath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        throw GitliteException("Cannot write file " + filePath + ".");
+    }
+    for (const auto& chunkId : parseChunkList(content)) {
+        std::string chunk = read(chunkId);
+        file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        Trace::count(Trace::BYTES_WRITTEN, static_cast<int64_t>(chunk.size()));
+    }
+}
+
+bool ObjectStore::peek(const std::string& blobId, std::string& list, uint64_t& size) const {
+    // Only the first line tells a chunk list apart, so look at just enough of
+    // the object to decode it instead of decompressing whole blobs
+    std::string blobPath = readPath(blobId);
+    std::string prefix = readPrefix(blobPath, FRAME_HEADER + PREFIX_INPUT);
+    if (isFramed(prefix)) {
+        size = 0;
+        for (int i = 0; i < 8; ++i) {
+            size |= static_cast<uint64_t>(static_cast<unsigned char>(prefix[5 + i])) << (8 * i);
+        }
+        std::string head;
+        if (prefix[4] == METHOD_STORED) {
+            head = prefix.substr(FRAME_HEADER);
+        } else if (prefix[4] == METHOD_COMPRESSED) {
+            head.assign(MAGIC_LENGTH, '\0');
+            if (!Compression::decompressPrefix(prefix.data() + FRAME_HEADER, prefix.size() - FRAME_HEADER,
+                                               &head[0], MAGIC_LENGTH)) {
+                head = CHUNK_LIST_MAGIC; // too short or odd: decode it whole below
+            }
+        }
+        if (!isChunkList(head)) {
+            return false;
+        }
+    } else if (!isChunkList(prefix)) {
+        struct stat info;
+        size = stat(blobPath.c_str(), &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+        return false;
+    }
+    if (!Utils::exists(blobPath) || !decode(Utils::readContentsAsString(blobPath), list) ||
+        !isChunkList(list)) {
+        return false;
+    }
+    // "size <total>" follows the magic line
+    size = std::strtoull(list.c_str() + MAGIC_LENGTH + std::strlen("size "), nullptr, 10);
+    return true;
+}
+
+std::vector<std::string> ObjectStore::chunksOf(const std::string& blobId) const {
+    std::string list;
+    uint64_t size;
+    return peek(blobId, list, size) ? parseChunkList(list) : std::vector<std::string>();
+}
+
+uint64_t ObjectStore::blobSize(const std::string& blobId, std::vector<std::string>* chunkIds) const {
+    std::string list;
+    uint64_t size = 0;
+    bool isList = peek(blobId, list, size);
+    if (chunkIds != nullptr) {
+        *chunkIds = isList ? parseChunkList(list) : std::vector<std::string>();
+    }
+    return size;
+}
+
+void ObjectStore::copyBlobTo(const std::string& blobId, const ObjectStore& other) const {
+    if (other.contains(blobId) || !contains(blobId)) {
+        return;
+    }
+    for (const auto& chunkId : chunksOf(blobId)) {
+        if (!other.contains(chunkId) && contains(chunkId)) {
+            copyTo(chunkId, other);
+        }
+    }
+    copyTo(blobId, other);
+}
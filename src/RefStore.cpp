@@ -0,0 +1,325 @@
+#include "../include/RefStore.h"
+#include "../include/LockFile.h"
+#include "../include/Utils.h"
+#include "../include/Worktree.h"
+#include <algorithm>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const std::string LOCK_SUFFIX = ".lock";
+const std::string PACKED_REFS = "packed-refs";
+const std::string PACKED_HEADER = "# pack-refs sorted\n";
+const std::string HEADS = "refs/heads/";
+const size_t ID_LENGTH = 40;
+
+bool isLockFile(const std::string& name) {
+    return name.size() >= LOCK_SUFFIX.size() &&
+           name.compare(name.size() - LOCK_SUFFIX.size(), LOCK_SUFFIX.size(), LOCK_SUFFIX) == 0;
+}
+
+/** Splits LINE, "<id> <name>", into NAME and VALUE; both are empty if it is
+ *  malformed. */
+void splitLine(std::string_view line, std::string_view& name, std::string_view& value) {
+    if (line.size() > ID_LENGTH + 1 && line[ID_LENGTH] == ' ') {
+        value = line.substr(0, ID_LENGTH);
+        name = line.substr(ID_LENGTH + 1);
+    } else {
+        value = name = std::string_view();
+    }
+}
+
+/** Looks up one ref in the packed-refs file by bisecting its bytes.  Each
+ *  probe reads a small block with pread, so a lookup touches a few blocks
+ *  of the file however many refs it holds. */
+class PackedLookup {
+public:
+    explicit PackedLookup(const std::string& path) {
+        fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) == 0) {
+            size = static_cast<size_t>(info.st_size);
+        }
+    }
+    ~PackedLookup() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    PackedLookup(const PackedLookup&) = delete;
+    PackedLookup& operator=(const PackedLookup&) = delete;
+
+    /** Returns the value of ref NAME, or "". */
+    std::string find(std::string_view name) {
+        size_t low = 0;
+        size_t high = size;
+        std::string line;
+        size_t start, next;
+        if (lineFrom(0, high, start, next, line) && line + "\n" == PACKED_HEADER) {
+            low = next;
+        }
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (!lineFrom(middle, high, start, next, line)) {
+                high = middle;
+                continue;
+            }
+            std::string_view lineName, value;
+            splitLine(line, lineName, value);
+            int order = lineName.compare(name);
+            if (order == 0) {
+                return std::string(value);
+            }
+            if (order < 0) {
+                low = next;
+            } else {
+                high = start;
+            }
+        }
+        return "";
+    }
+
+private:
+    /** Finds the first line starting at or after OFFSET and before LIMIT,
+     *  setting START, NEXT (the offset after its newline) and LINE.  Returns
+     *  false if there is none. */
+    bool lineFrom(size_t offset, size_t limit, size_t& start, size_t& next, std::string& line) {
+        // Read from one byte earlier, so that a line starting at OFFSET counts
+        size_t origin = offset == 0 ? 0 : offset - 1;
+        std::string buffer;
+        size_t begin = offset == 0 ? 0 : std::string::npos; // in BUFFER
+        while (true) {
+            if (begin == std::string::npos) {
+                size_t newline = buffer.find('\n');
+                begin = newline == std::string::npos ? newline : newline + 1;
+            }
+            size_t end = begin == std::string::npos ? begin : buffer.find('\n', begin);
+            if (end == std::string::npos && readBlock(origin + buffer.size(), buffer)) {
+                continue;
+            }
+            if (begin == std::string::npos || begin >= buffer.size() || origin + begin >= limit) {
+                return false;
+            }
+            if (end == std::string::npos) {
+                end = buffer.size(); // last line without a newline
+            }
+            start = origin + begin;
+            next = origin + end + 1;
+            line.assign(buffer, begin, end - begin);
+            return true;
+        }
+    }
+
+    /** Appends the block at POSITION to BUFFER; false at the end of file. */
+    bool readBlock(size_t position, std::string& buffer) {
+        if (position >= size) {
+            return false;
+        }
+        char block[BLOCK];
+        ssize_t n = pread(fd, block, BLOCK, static_cast<off_t>(position));
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(block, static_cast<size_t>(n));
+        return true;
+    }
+
+    static const size_t BLOCK = 256;
+    int fd = -1;
+    size_t size = 0;
+};
+
+std::string formatPacked(const std::vector<std::pair<std::string, std::string>>& refs) {
+    std::string text = PACKED_HEADER;
+    for (const auto& ref : refs) {
+        text += ref.second + " " + ref.first + "\n";
+    }
+    return text;
+}
+} // namespace
+
+RefStore::RefStore(const std::string& gitliteDir)
+    : gitliteDir(gitliteDir), commonDir(Worktree::commonDir(gitliteDir)) {}
+
+std::string RefStore::read(const std::string& name) const {
+    // Open once rather than test-then-read: the file may be replaced between
+    // the two, but an open descriptor always sees one complete version
+    std::ifstream file(path(name), std::ios::binary);
+    if (file.is_open()) {
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if (name.compare(0, 5, "refs/") != 0) {
+        return "";
+    }
+    return PackedLookup(path(PACKED_REFS)).find(name);
+}
+
+void RefStore::write(const std::string& name, const std::string& value) const {
+    LockFile lock(path(name));
+    lock.write(value);
+    lock.commit();
+}
+
+bool RefStore::compareAndSwap(const std::string& name, const std::string& expected,
+                              const std::string& value) const {
+    LockFile lock(path(name));
+    if (read(name) != expected) {
+        return false;
+    }
+    lock.write(value);
+    lock.commit();
+    return true;
+}
+
+bool RefStore::remove(const std::string& name, const std::string& expected) const {
+    LockFile lock(path(name));
+    if (read(name) != expected) {
+        return false;
+    }
+    // Drop the packed entry first, so that the ref never reappears with its
+    // packed value once the loose file is gone.  The packed file is checked
+    // under its lock, as a concurrent pack() may just be adding the ref.
+    LockFile packedLock(path(PACKED_REFS));
+    auto refs = packedRefs();
+    auto packed = std::find_if(refs.begin(), refs.end(),
+                               [&name](const std::pair<std::string, std::string>& ref) { return ref.first == name; });
+    if (packed != refs.end()) {
+        refs.erase(packed);
+        packedLock.write(formatPacked(refs));
+        packedLock.commit();
+    }
+    std::remove(path(name).c_str());
+    return true;
+}
+
+size_t RefStore::pack() const {
+    std::vector<std::pair<std::string, std::string>> refs;
+    {
+        LockFile packedLock(path(PACKED_REFS));
+        refs = allRefs();
+        packedLock.write(formatPacked(refs));
+        packedLock.commit();
+    }
+
+    // Prune the loose refs now in the packed file, unless they moved since
+    std::vector<std::string> emptied;
+    for (const auto& ref : refs) {
+        std::string loosePath = path(ref.first);
+        if (!Utils::isFile(loosePath)) {
+            continue;
+        }
+        LockFile lock(loosePath);
+        std::ifstream file(loosePath, std::ios::binary);
+        std::string value((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (value == ref.second) {
+            std::remove(loosePath.c_str());
+            for (size_t slash = ref.first.find_last_of('/'); slash >= HEADS.size();
+                 slash = ref.first.find_last_of('/', slash - 1)) {
+                emptied.push_back(ref.first.substr(0, slash));
+            }
+        }
+    }
+
+    // Remove directories of remote-tracking refs, deepest first; rmdir
+    // leaves any that still hold refs
+    std::sort(emptied.begin(), emptied.end(), [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() > b.size() : a < b;
+    });
+    emptied.erase(std::unique(emptied.begin(), emptied.end()), emptied.end());
+    for (const auto& dir : emptied) {
+        rmdir(path(dir).c_str());
+    }
+    return refs.size();
+}
+
+std::string RefStore::currentBranch() const {
+    std::string head = read("HEAD");
+    return head.size() > 16 ? head.substr(16) : ""; // Remove "ref: refs/heads/"
+}
+
+std::string RefStore::branchHead(const std::string& branch) const {
+    return read(branchRef(branch));
+}
+
+std::vector<std::string> RefStore::branches() const {
+    // Both lists are sorted; names only, so no loose ref needs to be read
+    std::vector<std::string> refs = looseRefs();
+    size_t looseCount = refs.size();
+    for (auto& ref : packedRefs()) {
+        refs.push_back(std::move(ref.first));
+    }
+    std::inplace_merge(refs.begin(), refs.begin() + looseCount, refs.end());
+    refs.erase(std::unique(refs.begin(), refs.end()), refs.end());
+
+    std::vector<std::string> names;
+    names.reserve(refs.size());
+    for (const auto& ref : refs) {
+        names.push_back(ref.substr(HEADS.size()));
+    }
+    return names;
+}
+
+std::vector<std::string> RefStore::localBranches() const {
+    std::vector<std::string> names;
+    for (auto& name : branches()) {
+        if (name.find('/') == std::string::npos) {
+            names.push_back(std::move(name));
+        }
+    }
+    return names;
+}
+
+std::vector<std::pair<std::string, std::string>> RefStore::allRefs() const {
+    // Merge the two sorted lists; a loose ref overrides its packed entry
+    std::vector<std::string> loose = looseRefs();
+    std::vector<std::pair<std::string, std::string>> packed = packedRefs();
+    std::vector<std::pair<std::string, std::string>> refs;
+    refs.reserve(loose.size() + packed.size());
+    size_t p = 0;
+    for (const auto& name : loose) {
+        while (p < packed.size() && packed[p].first < name) {
+            refs.push_back(std::move(packed[p++]));
+        }
+        if (p < packed.size() && packed[p].first == name) {
+            ++p;
+        }
+        std::string value = read(name);
+        if (!value.empty()) { // deleted since it was listed
+            refs.emplace_back(name, std::move(value));
+        }
+    }
+    while (p < packed.size()) {
+        refs.push_back(std::move(packed[p++]));
+    }
+    return refs;
+}
+
+std::vector<std::string> RefStore::looseRefs() const {
+    std::vector<std::string> names;
+    for (auto& name : Utils::plainFilenamesUnder(path("refs/heads"))) {
+        if (!isLockFile(name)) {
+            names.push_back(HEADS + name);
+        }
+    }
+    // plainFilenamesUnder sorts relative paths, which keeps prefixed names sorted
+    return names;
+}
+
+std::vector<std::pair<std::string, std::string>> RefStore::packedRefs() const {
+    std::vector<std::pair<std::string, std::string>> refs;
+    std::ifstream file(path(PACKED_REFS), std::ios::binary);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string_view name, value;
+        splitLine(line, name, value);
+        if (!name.empty()) {
+            refs.emplace_back(std::string(name), std::string(value));
+        }
+    }
+    return refs;
+}
@@ -0,0 +1,442 @@
+#include "../include/Repository.h"
+#include "../include/Fsmonitor.h"
+#include "../include/GitliteException.h"
+#include "../include/RefStore.h"
+#include "../include/RevWalk.h"
+#include "../include/Trace.h"
+#include "../include/Utils.h"
+#include <climits>
+
+Repository::WorkDirScope::WorkDirScope(const std::string &workDir) {
+    if (workDir == ".") {
+        return;
+    }
+    char buffer[PATH_MAX];
+    if (getcwd(buffer, sizeof(buffer)) == nullptr || chdir(workDir.c_str()) != 0) {
+        throw GitliteException("Cannot enter directory " + workDir + ".");
+    }
+    previous = buffer;
+}
+
+Repository::WorkDirScope::~WorkDirScope() {
+    if (!previous.empty() && chdir(previous.c_str()) != 0) {
+        std::cerr << "Cannot return to directory " << previous << "." << std::endl;
+    }
+}
+
+Repository::Repository(const std::string &workDir, std::ostream &out)
+    : workDir(workDir), repo(out) {}
+
+Repository Repository::init(const std::string &workDir, std::ostream &out) {
+    Utils::createDirectories(workDir);
+    Repository repository(workDir, out);
+    WorkDirScope scope(workDir);
+    repository.repo.init();
+    return repository;
+}
+
+void Repository::requireRepository() {
+    if (!Utils::isDirectory(".gitlite")) {
+        throw GitliteException("Not in an initialized Gitlite directory.");
+    }
+}
+
+namespace {
+void checkArgsNum(const std::vector<std::string> &args, size_t n) {
+    if (args.size() != n) {
+        throw GitliteException("Incorrect operands.");
+    }
+}
+} // namespace
+
+/**
+ * Dispatches one command line to SomeObj.  Checks that the repository is
+ * initialized and that the operand count is right before running a command.
+ */
+int Repository::execute(const std::vector<std::string> &args) {
+    if (args.empty()) {
+        throw GitliteException("Please enter a command.");
+    }
+    WorkDirScope scope(workDir);
+    const std::string &firstArg = args[0];
+    Trace::Region region(firstArg.c_str());
+
+    if (firstArg == "init") {
+        checkArgsNum(args, 1);
+        repo.init();
+        return 0;
+    }
+
+    if (firstArg == "clone") {
+        checkArgsNum(args, 3);
+        repo.clone(args[1], args[2]);
+        return 0;
+    }
+
+    if (firstArg == "add-remote") {
+        requireRepository();
+        checkArgsNum(args, 3);
+        repo.addRemote(args[1], args[2]);
+    } else if (firstArg == "rm-remote") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.rmRemote(args[1]);
+    } else if (firstArg == "add") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        if (args[1] == "-A") {
+            repo.addAll();
+        } else {
+            repo.add(args[1]);
+        }
+    } else if (firstArg == "commit") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.commit(args[1]);
+    } else if (firstArg == "rm") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.rm(args[1]);
+    } else if (firstArg == "log") {
+        requireRepository();
+        repo.log(std::vector<std::string>(args.begin() + 1, args.end()));
+    } else if (firstArg == "blame") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.blame(args[1]);
+    } else if (firstArg == "grep") {
+        requireRepository();
+        if (args.size() == 2) {
+            repo.grep(args[1]);
+        } else {
+            checkArgsNum(args, 3);
+            repo.grep(args[1], args[2]);
+        }
+    } else if (firstArg == "archive") {
+        requireRepository();
+        if (args.size() == 4 && args[2] == "-o") {
+            repo.archive(args[1], args[3]);
+        } else {
+            checkArgsNum(args, 2);
+            repo.archive(args[1]);
+        }
+    } else if (firstArg == "global-log") {
+        requireRepository();
+        checkArgsNum(args, 1);
+        repo.globalLog();
+    } else if (firstArg == "find") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.find(args[1]);
+    } else if (firstArg == "status") {
+        requireRepository();
+        checkArgsNum(args, 1);
+        repo.status();
+    } else if (firstArg == "checkout") {
+        requireRepository();
+        if (args.size() == 2) {
+            repo.checkoutBranch(args[1]);
+        } else if (args.size() == 3) {
+            if (args[1] != "--") {
+                throw GitliteException("Incorrect operands.");
+            }
+            repo.checkoutFile(args[2]);
+        } else if (args.size() == 4) {
+            if (args[2] != "--") {
+                throw GitliteException("Incorrect operands.");
+            }
+            repo.checkoutFileInCommit(args[1], args[3]);
+        } else {
+            throw GitliteException("Incorrect operands.");
+        }
+    } else if (firstArg == "branch") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.branch(args[1]);
+    } else if (firstArg == "rm-branch") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.rmBranch(args[1]);
+    } else if (firstArg == "reset") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.reset(args[1]);
+    } else if (firstArg == "merge") {
+        requireRepository();
+        checkArgsNum(args, 2);
+        repo.merge(args[1]);
+    } else if (firstArg == "push") {
+        requireRepository();
+        checkArgsNum(args, 3);
+        repo.push(args[1], args[2]);
+    } else if (firstArg == "fetch") {
+        requireRepository();
+        checkArgsNum(args, 3);
+        repo.fetch(args[1], args[2]);
+    } else if (firstArg == "pull") {
+        requireRepository();
+        checkArgsNum(args, 3);
+        repo.pull(args[1], args[2]);
+    } else if (firstArg == "gc") {
+        requireRepository();
+        long long gracePeriod = 14LL * 24 * 60 * 60;
+        if (args.size() == 2) {
+            if (args[1] == "--prune=now") {
+                gracePeriod = 0;
+            } else if (args[1].rfind("--prune=", 0) == 0 &&
+                       args[1].size() > 8 &&
+                       args[1].find_first_not_of("0123456789", 8) == std::string::npos) {
+                gracePeriod = std::stoll(args[1].substr(8));
+            } else {
+                throw GitliteException("Incorrect operands.");
+            }
+        } else {
+            checkArgsNum(args, 1);
+        }
+        repo.gc(gracePeriod);
+    } else if (firstArg == "fsck") {
+        requireRepository();
+        checkArgsNum(args, 1);
+        return repo.fsck() ? 0 : 1;
+    } else if (firstArg == "pack-refs") {
+        requireRepository();
+        checkArgsNum(args, 1);
+        repo.packRefs();
+    } else if (firstArg == "worktree") {
+        requireRepository();
+        if (args.size() == 4 && args[1] == "add") {
+            repo.addWorktree(args[2], args[3]);
+        } else if (args.size() == 2 && args[1] == "list") {
+            repo.listWorktrees();
+        } else {
+            throw GitliteException("Incorrect operands.");
+        }
+    } else if (firstArg == "sparse-checkout") {
+        requireRepository();
+        if (args.size() >= 3 && args[1] == "set") {
+            repo.setSparseCheckout(std::vector<std::string>(args.begin() + 2, args.end()));
+        } else if (args.size() == 2 && args[1] == "disable") {
+            repo.setSparseCheckout({});
+        } else if (args.size() == 2 && args[1] == "list") {
+            repo.listSparseCheckout();
+        } else {
+            throw GitliteException("Incorrect operands.");
+        }
+    } else if (firstArg == "fsmonitor") {
+        requireRepository();
+        if (args.size() == 1 || (args.size() == 2 && args[1] == "--foreground")) {
+            // Starting the daemon forks, which a library must not do to its host
+            throw GitliteException("The fsmonitor daemon can only be started by the gitlite command.");
+        } else if (args.size() == 2 && args[1] == "--stop") {
+            if (!Fsmonitor::stop()) {
+                throw GitliteException("No fsmonitor daemon is running.");
+            }
+        } else {
+            throw GitliteException("Incorrect operands.");
+        }
+    } else {
+        throw GitliteException("No command with that name exists.");
+    }
+    return 0;
+}
+
+bool Repository::isInitialized() {
+    WorkDirScope scope(workDir);
+    return Utils::isDirectory(".gitlite");
+}
+
+std::string Repository::currentBranch() {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    return RefStore().currentBranch();
+}
+
+std::string Repository::headCommitId() {
+    std::string branchName = currentBranch();
+    WorkDirScope scope(workDir);
+    return RefStore().branchHead(branchName);
+}
+
+std::vector<std::string> Repository::branches() {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    return RefStore().localBranches();
+}
+
+Commit Repository::readCommit(const std::string &commitId) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    return Commit::read(commitId);
+}
+
+/** Returns the first-parent history of HEAD, newest first. */
+std::vector<Commit> Repository::log() {
+    std::string commitId = headCommitId();
+    WorkDirScope scope(workDir);
+    RevWalk walk;
+    walk.push(commitId);
+    std::vector<Commit> history;
+    Commit commit;
+    while (walk.next(commit)) {
+        history.push_back(commit);
+    }
+    return history;
+}
+
+Manifest Repository::filesInCommit(const std::string &commitId) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    return repo.getFilesInCommit(commitId);
+}
+
+StatusReport Repository::status() {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    return repo.getStatus();
+}
+
+void Repository::add(const std::string &filename) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.add(filename);
+}
+
+/** Commits the staged changes and returns the new commit's ID. */
+std::string Repository::commit(const std::string &message) {
+    {
+        WorkDirScope scope(workDir);
+        requireRepository();
+        repo.commit(message);
+    }
+    return headCommitId();
+}
+
+void Repository::addAll() {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.addAll();
+}
+
+void Repository::rm(const std::string &filename) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.rm(filename);
+}
+
+void Repository::checkoutFile(const std::string &filename) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.checkoutFile(filename);
+}
+
+void Repository::checkoutFile(const std::string &commitId, const std::string &filename) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.checkoutFileInCommit(commitId, filename);
+}
+
+void Repository::checkoutBranch(const std::string &branchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.checkoutBranch(branchName);
+}
+
+void Repository::branch(const std::string &branchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.branch(branchName);
+}
+
+void Repository::rmBranch(const std::string &branchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.rmBranch(branchName);
+}
+
+void Repository::reset(const std::string &commitId) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.reset(commitId);
+}
+
+void Repository::merge(const std::string &branchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.merge(branchName);
+}
+
+void Repository::addRemote(const std::string &remoteName, const std::string &remoteDir) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.addRemote(remoteName, remoteDir);
+}
+
+void Repository::rmRemote(const std::string &remoteName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.rmRemote(remoteName);
+}
+
+void Repository::push(const std::string &remoteName, const std::string &remoteBranchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.push(remoteName, remoteBranchName);
+}
+
+void Repository::fetch(const std::string &remoteName, const std::string &remoteBranchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.fetch(remoteName, remoteBranchName);
+}
+
+void Repository::pull(const std::string &remoteName, const std::string &remoteBranchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.pull(remoteName, remoteBranchName);
+}
+
+void Repository::gc(long long gracePeriodSeconds) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.gc(gracePeriodSeconds);
+}
+
+bool Repository::fsck() {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    return repo.fsck();
+}
+
+void Repository::packRefs() {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.packRefs();
+}
+
+void Repository::setSparseCheckout(const std::vector<std::string> &patterns) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.setSparseCheckout(patterns);
+}
+
+void Repository::addWorktree(const std::string &dir, const std::string &branchName) {
+    WorkDirScope scope(workDir);
+    requireRepository();
+    repo.addWorktree(dir, branchName);
+}
+
+Repository Repository::clone(const std::string &sourceDir, const std::string &workDir, std::ostream &out) {
+    // SOURCEDIR is relative to the caller's directory, not to the clone
+    char sourcePath[PATH_MAX];
+    if (realpath(sourceDir.c_str(), sourcePath) == nullptr) {
+        throw GitliteException("Source repository not found.");
+    }
+    if (Utils::exists(workDir) && !Utils::isEmptyDirectory(workDir)) {
+        throw GitliteException(workDir + " already exists.");
+    }
+    Utils::createDirectories(workDir);
+    Repository repository(workDir, out);
+    WorkDirScope scope(workDir);
+    repository.repo.clone(sourcePath, ".");
+    return repository;
+}
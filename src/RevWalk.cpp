@@ -0,0 +1,181 @@
+#include "../include/RevWalk.h"
+#include "../include/Manifest.h"
+#include "../include/Trace.h"
+#include "../include/Utils.h"
+#include <algorithm>
+
+/** Returns the node for COMMITID, or nullptr if there is no such commit
+ *  object.  A commit with a changed-paths line is not read yet; any other
+ *  is read the first time it is needed. */
+RevWalk::Node* RevWalk::lookup(const ObjectId& commitId) {
+    if (Node** known = index.find(commitId)) {
+        return *known;
+    }
+    Node* node = nullptr;
+    const ChangedPaths::Record* record = changedPaths ? changedPaths->find(commitId) : nullptr;
+    std::string content;
+    if (record != nullptr) {
+        nodes.emplace_back();
+        node = &nodes.back();
+        node->commit.id = commitId.hex();
+        node->commit.timestamp = record->timestamp;
+        node->parents = record->parents;
+        node->record = record;
+    } else if (store.read(commitId.hex(), content)) {
+        nodes.emplace_back();
+        node = &nodes.back();
+        node->commit = Commit::parse(commitId.hex(), content);
+        node->parsed = true;
+        for (const auto& parent : node->commit.parents) {
+            ObjectId parentId;
+            if (ObjectId::parse(parent, parentId)) {
+                node->parents.push_back(parentId);
+            }
+        }
+    }
+    index.insert(commitId, node);
+    return node;
+}
+
+/** Reads NODE's commit object into CONTENT, parsing it if that has not been
+ *  done.  Returns false if it cannot be read. */
+bool RevWalk::parse(Node* node, std::string& content) {
+    if (!store.read(node->commit.id, content)) {
+        return false;
+    }
+    if (!node->parsed) {
+        node->commit = Commit::parse(node->commit.id, content);
+        node->parsed = true;
+    }
+    return true;
+}
+
+/** Whether NODE's commit changes the walk's path relative to its first
+ *  parent.  The filter answers "no" for certain; a "maybe" is settled by
+ *  comparing the two commits' blobs of the path. */
+bool RevWalk::changesPath(Node* node) {
+    if (node->record != nullptr && !ChangedPaths::mayChange(*node->record, path)) {
+        Trace::count(Trace::FILTER_SKIPS);
+        return false;
+    }
+    std::string content;
+    if (!parse(node, content)) {
+        return false;
+    }
+    ObjectId blobId = Manifest::fromCommit(std::move(content)).blobId(path);
+    ObjectId parentBlobId;
+    if (!node->parents.empty() && store.read(node->parents[0].hex(), content)) {
+        parentBlobId = Manifest::fromCommit(std::move(content)).blobId(path);
+    }
+    return blobId != parentBlobId;
+}
+
+void RevWalk::enqueue(Node* node) {
+    queue.push({node->commit.timestamp, node->hidden, insertions++, node});
+    if (!node->hidden) {
+        node->queued = true;
+        ++visibleQueued;
+    }
+}
+
+/** Marks NODE hidden.  A node that was already walked passes the mark on to
+ *  its parents at once; any other node does so when it is walked. */
+void RevWalk::markHidden(Node* node) {
+    std::vector<Node*> pending = {node};
+    while (!pending.empty()) {
+        Node* current = pending.back();
+        pending.pop_back();
+        if (current->hidden) {
+            continue;
+        }
+        current->hidden = true;
+        if (!current->done) {
+            enqueue(current);
+            continue;
+        }
+        for (const auto& parentId : current->parents) {
+            if (Node* parent = lookup(parentId)) {
+                pending.push_back(parent);
+            }
+        }
+    }
+}
+
+void RevWalk::setPath(const std::string& path) {
+    this->path = path;
+    if (!changedPaths) {
+        changedPaths.reset(new ChangedPaths);
+    }
+}
+
+void RevWalk::push(const std::string& commitId) {
+    ObjectId id;
+    Node* node = ObjectId::parse(commitId, id) ? lookup(id) : nullptr;
+    if (node != nullptr && !node->hidden && !node->queued) {
+        enqueue(node);
+    }
+}
+
+void RevWalk::hide(const std::string& commitId) {
+    ObjectId id;
+    if (Node* node = ObjectId::parse(commitId, id) ? lookup(id) : nullptr) {
+        markHidden(node);
+    }
+}
+
+bool RevWalk::next(Commit& commit) {
+    while (visibleQueued > 0 && !queue.empty()) {
+        if (maxCount >= 0 && shown >= maxCount) {
+            return false;
+        }
+        Entry entry = queue.top();
+        queue.pop();
+        if (!entry.hidden) {
+            --visibleQueued;
+        }
+        Node* node = entry.node;
+        // Skip entries made stale by a later hide, and duplicates
+        if (entry.hidden != node->hidden || node->done) {
+            continue;
+        }
+        node->done = true;
+
+        if (node->hidden) {
+            for (const auto& parentId : node->parents) {
+                if (Node* parent = lookup(parentId)) {
+                    markHidden(parent);
+                }
+            }
+            continue;
+        }
+
+        // Everything still queued is at most this old
+        if (hasSince && node->commit.timestamp < since) {
+            return false;
+        }
+
+        const auto& parents = node->parents;
+        size_t followed = firstParent ? std::min<size_t>(1, parents.size()) : parents.size();
+        for (size_t i = 0; i < followed; ++i) {
+            Node* parent = lookup(parents[i]);
+            if (parent != nullptr && !parent->hidden && !parent->queued) {
+                enqueue(parent);
+            }
+        }
+
+        if (hasUntil && node->commit.timestamp > until) {
+            continue;
+        }
+        if (changedPaths && !changesPath(node)) {
+            continue;
+        }
+        std::string content;
+        if (!node->parsed && !parse(node, content)) {
+            continue;
+        }
+        commit = node->commit;
+        ++shown;
+        return true;
+    }
+    return false;
+}
@@ -1,7 +1,25 @@
 #include "../include/SomeObj.h"
+#include "../include/ChangedPaths.h"
+#include "../include/Commit.h"
+#include "../include/Fsmonitor.h"
+#include "../include/GitliteException.h"
+#include "../include/IgnoreRules.h"
+#include "../include/LineDiff.h"
+#include "../include/Manifest.h"
+#include "../include/ObjectStore.h"
+#include "../include/RefStore.h"
 #include "../include/Repository.h"
+#include "../include/RevWalk.h"
+#include "../include/SparseCheckout.h"
+#include "../include/TarWriter.h"
+#include "../include/TextSearch.h"
 #include "../include/Utils.h"
+#include "../include/ThreadPool.h"
+#include "../include/Trace.h"
+#include "../include/Worktree.h"
+#include <algorithm>
 #include <ctime>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -9,8 +27,31 @@
 #include <queue>
 #include <unordered_map>
 #include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <unordered_set>
 
-SomeObj::SomeObj() {}
+SomeObj::SomeObj(std::ostream &out) : out(out) {}
+
+const int SomeObj::REF_UPDATE_ATTEMPTS;
+const size_t SomeObj::PARALLEL_STATUS_THRESHOLD;
+const long long SomeObj::TEMPORARY_GRACE_SECONDS;
+const size_t SomeObj::ARCHIVE_READ_AHEAD;
+const size_t SomeObj::ARCHIVE_READ_AHEAD_BYTES;
+
+SomeObj::StagingLock::StagingLock(SomeObj &owner) : owner(owner) {
+    if (owner.stagingLockDepth == 0) {
+        owner.stagingLock.reset(new LockFile(".gitlite/staging"));
+    }
+    ++owner.stagingLockDepth;
+}
+
+SomeObj::StagingLock::~StagingLock() {
+    if (--owner.stagingLockDepth == 0) {
+        owner.stagingLock.reset();
+    }
+}
 
 /**
  * Initializes a new Gitlite repository.
@@ -20,7 +61,7 @@ SomeObj::SomeObj() {}
  */
 void SomeObj::init() {
     if (Utils::isDirectory(".gitlite")) {
-        Utils::exitWithMessage("A Gitlite version-control system already exists in the current directory.");
+        throw GitliteException("A Gitlite version-control system already exists in the current directory.");
     }
 
     // Create .gitlite directory structure
@@ -39,13 +80,15 @@ void SomeObj::init() {
     commitContent += "files \n";
 
     std::string commitId = Utils::sha1(commitContent);
-    Utils::writeContents(".gitlite/objects/" + commitId, commitContent);
+    ObjectStore().write(commitId, commitContent);
+    ChangedPaths::append(".gitlite/objects", commitId, commitContent, Manifest());
 
     // Create master branch pointing to initial commit
-    Utils::writeContents(".gitlite/refs/heads/master", commitId);
+    RefStore refs;
+    refs.write(RefStore::branchRef("master"), commitId);
 
     // Set HEAD to master
-    Utils::writeContents(".gitlite/HEAD", "ref: refs/heads/master");
+    refs.write("HEAD", "ref: refs/heads/master");
 }
 
 /**
@@ -56,32 +99,29 @@ void SomeObj::init() {
  */
 void SomeObj::add(const std::string &filename) {
     if (!Utils::exists(filename)) {
-        Utils::exitWithMessage("File does not exist.");
+        throw GitliteException("File does not exist.");
     }
 
     // Read file content
     std::string content = Utils::readContentsAsString(filename);
-    std::string blobId = Utils::sha1(content);
-
-    // Store blob if not exists
-    std::string blobPath = ".gitlite/objects/" + blobId;
-    if (!Utils::exists(blobPath)) {
-        Utils::writeContents(blobPath, content);
+    std::string blobId;
+    {
+        Trace::Region region("hash");
+        blobId = Utils::sha1(content);
     }
 
-    // Get current commit to check if file is the same as in current commit
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
+    // Store blob (chunked if large) if not exists; otherwise freshen it so a concurrent gc keeps it
+    ObjectStore().writeBlob(blobId, content);
 
-    auto currentCommitFiles = getFilesInCommit(currentCommitId);
-    bool fileInCurrentCommit = currentCommitFiles.find(filename) != currentCommitFiles.end();
-    bool sameAsCurrentCommit = false;
+    StagingLock lock(*this);
 
-    if (fileInCurrentCommit) {
-        std::string currentBlobId = currentCommitFiles[filename];
-        sameAsCurrentCommit = (currentBlobId == blobId);
-    }
+    // Get current commit to check if file is the same as in current commit
+    RefStore refs;
+    std::string currentCommitId = refs.branchHead(refs.currentBranch());
+
+    Manifest currentCommitFiles = getFilesInCommit(currentCommitId);
+    const Manifest::Entry *tracked = currentCommitFiles.find(filename);
+    bool sameAsCurrentCommit = tracked && tracked->blobId == ObjectId::fromHex(blobId);
 
     // Check if file is staged for removal
     bool stagedForRemoval = false;
@@ -117,18 +157,18 @@ void SomeObj::add(const std::string &filename) {
  */
 void SomeObj::commit(const std::string &message) {
     if (message.empty()) {
-        Utils::exitWithMessage("Please enter a commit message.");
+        throw GitliteException("Please enter a commit message.");
     }
 
+    StagingLock lock(*this);
+
     // Check if there are staged changes
     if (!Utils::isDirectory(".gitlite/staging") || Utils::plainFilenamesIn(".gitlite/staging").empty()) {
-        Utils::exitWithMessage("No changes added to the commit.");
+        throw GitliteException("No changes added to the commit.");
     }
 
-    // Get current commit
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16); // Remove "ref: refs/heads/"
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
+    RefStore refs;
+    std::string currentBranch = refs.currentBranch();
 
     // Get current timestamp
     auto now = std::time(nullptr);
@@ -137,40 +177,46 @@ void SomeObj::commit(const std::string &message) {
     oss << std::put_time(&tm, "%a %b %d %H:%M:%S %Y %z");
     std::string timestamp = std::to_string(now);
 
-    // Create commit content
-    std::string commitContent = "parent " + currentCommitId + "\n";
-    commitContent += "timestamp " + timestamp + "\n";
-    commitContent += "message " + message + "\n";
-    commitContent += "files ";
-
-    // Start with files from current commit
-    auto currentCommitFiles = getFilesInCommit(currentCommitId);
+    // The staging lock does not cover the branch itself (a push from another
+    // repository may move it), so if it moves before the update, back off and
+    // commit again on top of its new head
+    Backoff backoff;
+    for (int attempt = 1;; ++attempt) {
+        std::string currentCommitId = refs.branchHead(currentBranch);
+
+        // Create commit content
+        std::string commitContent = "parent " + currentCommitId + "\n";
+        commitContent += "timestamp " + timestamp + "\n";
+        commitContent += "message " + message + "\n";
+        commitContent += "files ";
+
+        // Files from current commit, updated with staged changes
+        Manifest parentFiles = getFilesInCommit(currentCommitId);
+        {
+            Trace::Region applyRegion("commit.apply_staging");
+            commitContent += applyStaging(parentFiles);
+            commitContent += "\n";
+        }
 
-    // Apply staged changes
-    auto stagedFiles = Utils::plainFilenamesIn(".gitlite/staging");
-    for (const auto &file : stagedFiles) {
-        std::string blobId = Utils::readContentsAsString(".gitlite/staging/" + file);
-        if (blobId == "DELETE") {
-            // Remove file from commit
-            currentCommitFiles.erase(file);
-        } else {
-            // Add or update file in commit
-            currentCommitFiles[file] = blobId;
+        // Create commit
+        std::string newCommitId;
+        {
+            Trace::Region region("hash");
+            newCommitId = Utils::sha1(commitContent);
         }
-    }
+        ObjectStore().write(newCommitId, commitContent);
 
-    // Build files section from the updated map
-    for (const auto &pair : currentCommitFiles) {
-        commitContent += pair.first + ":" + pair.second + ";";
+        // Update branch reference; a commit that lost the race is left for gc
+        Trace::Region region("ref_update");
+        if (refs.compareAndSwap(RefStore::branchRef(currentBranch), currentCommitId, newCommitId)) {
+            ChangedPaths::append(".gitlite/objects", newCommitId, commitContent, parentFiles);
+            break;
+        }
+        if (attempt == REF_UPDATE_ATTEMPTS) {
+            throw GitliteException("Branch " + currentBranch + " is being updated by another process; try again.");
+        }
+        backoff.wait();
     }
-    commitContent += "\n";
-
-    // Create commit
-    std::string newCommitId = Utils::sha1(commitContent);
-    Utils::writeContents(".gitlite/objects/" + newCommitId, commitContent);
-
-    // Update branch reference
-    Utils::writeContents(".gitlite/refs/heads/" + currentBranch, newCommitId);
 
     // Clear staging area
     std::string command = "rm -rf .gitlite/staging";
@@ -183,31 +229,17 @@ void SomeObj::commit(const std::string &message) {
  * If the file is tracked in the current commit, it is staged for removal and removed from the working directory.
  */
 void SomeObj::rm(const std::string &filename) {
+    StagingLock lock(*this);
     bool fileStaged = Utils::exists(".gitlite/staging/" + filename);
-    bool fileTracked = false;
 
     // Check if file is tracked in current commit
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-
-    if (Utils::exists(".gitlite/objects/" + currentCommitId)) {
-        std::string commitContent = Utils::readContentsAsString(".gitlite/objects/" + currentCommitId);
-        size_t filesPos = commitContent.find("files ");
-        if (filesPos != std::string::npos) {
-            std::string filesSection = commitContent.substr(filesPos + 6);
-            size_t newlinePos = filesSection.find('\n');
-            if (newlinePos != std::string::npos) {
-                filesSection = filesSection.substr(0, newlinePos);
-            }
-            if (filesSection.find(filename + ":") != std::string::npos) {
-                fileTracked = true;
-            }
-        }
-    }
+    RefStore refs;
+    std::string currentCommitId = refs.branchHead(refs.currentBranch());
+
+    bool fileTracked = getFilesInCommit(currentCommitId).contains(filename);
 
     if (!fileStaged && !fileTracked) {
-        Utils::exitWithMessage("No reason to remove the file.");
+        throw GitliteException("No reason to remove the file.");
     }
 
     // If file is staged but not tracked, unstage it
@@ -227,73 +259,404 @@ void SomeObj::rm(const std::string &filename) {
 }
 
 /**
- * Displays the commit history starting from the current HEAD.
- * Shows the commit ID, date, and message for each commit.
- * For merge commits, it also displays the parent commit IDs.
+ * Stages every change in the working directory ("add -A"): new and modified
+ * files are added and deleted ones are staged for removal.  The files to
+ * visit come from getStatus(), so the fsmonitor daemon narrows the scan.
  */
-void SomeObj::log() {
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-
-    while (!currentCommitId.empty()) {
-        std::string commitPath = ".gitlite/objects/" + currentCommitId;
-        if (!Utils::exists(commitPath)) {
-            break;
+void SomeObj::addAll() {
+    StagingLock lock(*this);
+    StatusReport report = getStatus();
+    for (const auto &modification : report.modifications) {
+        if (modification.second == "deleted") {
+            rm(modification.first);
+        } else {
+            add(modification.first);
         }
+    }
+    for (const auto &file : report.untracked) {
+        add(file);
+    }
+}
 
-        std::string commitContent = Utils::readContentsAsString(commitPath);
+namespace {
+/** Parses a non-negative decimal count, or throws "Incorrect operands.". */
+long long parseCount(const std::string &text) {
+    if (text.empty() || text.size() > 18 || text.find_first_not_of("0123456789") != std::string::npos) {
+        throw GitliteException("Incorrect operands.");
+    }
+    return std::stoll(text);
+}
 
-        // Parse commit information
-        std::string parent, timestamp, message;
-        size_t pos = 0;
+/** Parses "<epoch seconds>", "YYYY-MM-DD" or "YYYY-MM-DD HH:MM[:SS]" (local time). */
+std::time_t parseDate(const std::string &text) {
+    if (!text.empty() && text.find_first_not_of("0123456789") == std::string::npos) {
+        return static_cast<std::time_t>(parseCount(text));
+    }
+    std::tm tm = {};
+    int consumed = 0;
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &consumed) != 3) {
+        throw GitliteException("Incorrect operands.");
+    }
+    if (static_cast<size_t>(consumed) < text.size()) {
+        int more = 0;
+        if (std::sscanf(text.c_str() + consumed, " %2d:%2d%n", &tm.tm_hour, &tm.tm_min, &more) != 2) {
+            throw GitliteException("Incorrect operands.");
+        }
+        consumed += more;
+        if (text[consumed] == ':') {
+            if (std::sscanf(text.c_str() + consumed, ":%2d%n", &tm.tm_sec, &more) != 1) {
+                throw GitliteException("Incorrect operands.");
+            }
+            consumed += more;
+        }
+        if (static_cast<size_t>(consumed) != text.size()) {
+            throw GitliteException("Incorrect operands.");
+        }
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return std::mktime(&tm);
+}
+} // namespace
 
-        pos = commitContent.find("parent ");
-        if (pos != std::string::npos) {
-            size_t end = commitContent.find('\n', pos);
-            parent = commitContent.substr(pos + 7, end - pos - 7);
+/**
+ * Displays commit history, newest first, showing the commit ID, date and
+ * message of each commit (and both parents of merge commits).  Without
+ * OPTIONS this is the first-parent history of HEAD.  OPTIONS may hold one
+ * revision (branch name or commit ID) or range "A..B" (commits reachable
+ * from B but not A; an empty side means HEAD), "-n N", "--since=DATE",
+ * "--until=DATE", "--first-parent" and "--full-history" (follow all parents).
+ */
+void SomeObj::log(const std::vector<std::string> &options) {
+    RevWalk walk;
+    bool haveRevision = false;
+    // "-- <path>" ends the options; the path must be set before any push
+    auto separator = std::find(options.begin(), options.end(), "--");
+    if (separator != options.end()) {
+        if (options.end() - separator != 2) {
+            throw GitliteException("Incorrect operands.");
+        }
+        walk.setPath(separator[1]);
+    }
+    size_t end = static_cast<size_t>(separator - options.begin());
+    for (size_t i = 0; i < end; ++i) {
+        const std::string &option = options[i];
+        if (option == "-n" && i + 1 < end) {
+            walk.setMaxCount(parseCount(options[++i]));
+        } else if (option.rfind("--max-count=", 0) == 0) {
+            walk.setMaxCount(parseCount(option.substr(12)));
+        } else if (option.rfind("-n", 0) == 0 && option.size() > 2) {
+            walk.setMaxCount(parseCount(option.substr(2)));
+        } else if (option.rfind("--since=", 0) == 0) {
+            walk.setSince(parseDate(option.substr(8)));
+        } else if (option.rfind("--until=", 0) == 0) {
+            walk.setUntil(parseDate(option.substr(8)));
+        } else if (option == "--first-parent") {
+            walk.setFirstParent(true);
+        } else if (option == "--full-history") {
+            walk.setFirstParent(false);
+        } else if (!option.empty() && option[0] != '-' && !haveRevision) {
+            haveRevision = true;
+            size_t dots = option.find("..");
+            if (dots == std::string::npos) {
+                walk.push(resolveRevision(option));
+            } else {
+                walk.hide(resolveRevision(option.substr(0, dots)));
+                walk.push(resolveRevision(option.substr(dots + 2)));
+            }
+        } else {
+            throw GitliteException("Incorrect operands.");
         }
+    }
+    if (!haveRevision) {
+        walk.push(resolveRevision(""));
+    }
 
-        pos = commitContent.find("timestamp ");
-        if (pos != std::string::npos) {
-            size_t end = commitContent.find('\n', pos);
-            std::string timestampStr = commitContent.substr(pos + 10, end - pos - 10);
-            std::time_t ts = std::stoll(timestampStr);
-            auto tm = *std::localtime(&ts);
-            std::ostringstream oss;
-            oss << std::put_time(&tm, "%a %b %d %H:%M:%S %Y %z");
-            timestamp = oss.str();
+    Commit commit;
+    while (walk.next(commit)) {
+        out << "===\ncommit " << commit.id << '\n';
+        if (commit.parents.size() > 1) {
+            out << "Merge: " << commit.parents[0].substr(0, 7) << " " << commit.parents[1].substr(0, 7) << '\n';
         }
+        out << "Date: " << Commit::formatDate(commit.timestamp) << '\n'
+            << commit.message << "\n\n";
+    }
+    out.flush();
+}
 
-        pos = commitContent.find("message ");
-        if (pos != std::string::npos) {
-            size_t end = commitContent.find('\n', pos);
-            message = commitContent.substr(pos + 8, end - pos - 8);
+/**
+ * Prints every line of FILENAME in the head commit with the commit that last changed it.
+ * History is walked from HEAD along first parents, visiting only the commits that change the
+ * file (see RevWalk::setPath); each such commit's version is diffed against its parent's, and
+ * the lines it added are attributed to it. The walk ends as soon as every line is attributed.
+ */
+void SomeObj::blame(const std::string &filename) {
+    std::string headId = resolveRevision("");
+    ObjectStore store;
+    ObjectId blobId = getFilesInCommit(headId).blobId(filename);
+    if (blobId.isNull()) {
+        throw GitliteException("File does not exist in that commit.");
+    }
+    std::string text = store.readBlob(blobId.hex());
+    std::vector<std::string_view> lines = LineDiff::splitLines(text);
+
+    // TRACKED[i]: the head line that line i of the version being examined
+    // became, or NONE once attributed
+    std::vector<size_t> tracked(lines.size());
+    for (size_t i = 0; i < tracked.size(); ++i) {
+        tracked[i] = i;
+    }
+    std::vector<const Commit *> owners(lines.size(), nullptr);
+    std::deque<Commit> commits;
+    size_t remaining = lines.size();
+
+    RevWalk walk;
+    walk.setPath(filename);
+    walk.push(headId);
+    std::string version = text;
+    Commit commit;
+    while (remaining > 0 && walk.next(commit)) {
+        commits.push_back(commit);
+        std::string parentVersion;
+        if (!commit.parents.empty()) {
+            ObjectId parentBlobId = getFilesInCommit(commit.parents[0]).blobId(filename);
+            if (!parentBlobId.isNull()) {
+                parentVersion = store.readBlob(parentBlobId.hex());
+            }
+        }
+        std::vector<std::string_view> parentLines = LineDiff::splitLines(parentVersion);
+        std::vector<size_t> kept = LineDiff::match(parentLines, LineDiff::splitLines(version));
+        std::vector<size_t> parentTracked(parentLines.size(), LineDiff::NONE);
+        for (size_t i = 0; i < kept.size(); ++i) {
+            if (tracked[i] == LineDiff::NONE) {
+                continue;
+            }
+            if (kept[i] == LineDiff::NONE) {
+                owners[tracked[i]] = &commits.back();
+                --remaining;
+            } else {
+                parentTracked[kept[i]] = tracked[i];
+            }
+        }
+        tracked = std::move(parentTracked);
+        version = std::move(parentVersion);
+    }
+
+    size_t width = std::to_string(lines.size()).size();
+    for (size_t i = 0; i < lines.size(); ++i) {
+        // Only if history is cut short, e.g. by a missing object
+        const Commit *owner = owners[i] != nullptr ? owners[i] : commits.empty() ? nullptr : &commits.back();
+        out << (owner != nullptr ? owner->id.substr(0, 8) : std::string(8, '?')) << " ("
+            << (owner != nullptr ? Commit::formatDate(owner->timestamp) : std::string()) << ' '
+            << std::setw(static_cast<int>(width)) << i + 1 << ") " << lines[i] << '\n';
+    }
+    out.flush();
+}
+
+/**
+ * Prints "<file>:<line number>:<line>" for each line matching PATTERN in the files of the commit
+ * named by REVISION (HEAD if empty), in manifest order. Blobs are read from the object store, so
+ * nothing is checked out; each distinct blob is searched once, on the thread pool, however many
+ * files share it.
+ */
+void SomeObj::grep(const std::string &pattern, const std::string &revision) {
+    std::unique_ptr<TextSearch> search;
+    try {
+        search.reset(new TextSearch(pattern));
+    } catch (const std::regex_error &) {
+        throw GitliteException("Invalid pattern.");
+    }
+    Manifest files = getFilesInCommit(resolveRevision(revision));
+
+    // One slot per distinct blob, in order of first appearance
+    ObjectIdMap<size_t> slotOf;
+    std::vector<ObjectId> blobIds;
+    std::vector<size_t> slots;
+    slots.reserve(files.size());
+    for (const auto &entry : files) {
+        auto inserted = slotOf.insert(entry.blobId, blobIds.size());
+        if (inserted.second) {
+            blobIds.push_back(entry.blobId);
         }
+        slots.push_back(*inserted.first);
+    }
 
-        // Print commit information
-        std::cout << "===" << std::endl;
-        std::cout << "commit " << currentCommitId << std::endl;
+    // Matching lines are copied out, so each blob is freed once searched
+    std::vector<std::vector<std::pair<size_t, std::string>>> matches(blobIds.size());
+    ObjectStore store;
+    {
+        Trace::Region region("grep.search");
+        ThreadPool pool;
+        size_t batchSize = std::max<size_t>(1, blobIds.size() / (pool.size() * 8) + 1);
+        for (size_t begin = 0; begin < blobIds.size(); begin += batchSize) {
+            size_t end = std::min(blobIds.size(), begin + batchSize);
+            pool.submit([&blobIds, &matches, &store, &search, begin, end] {
+                std::vector<std::pair<size_t, std::string_view>> found;
+                for (size_t i = begin; i < end; ++i) {
+                    std::string content = store.readBlob(blobIds[i].hex());
+                    found.clear();
+                    search->search(content, found);
+                    for (const auto &match : found) {
+                        matches[i].emplace_back(match.first, std::string(match.second));
+                    }
+                }
+            });
+        }
+        pool.wait();
+    }
 
-        // Check if this is a merge commit (has two parents)
-        size_t spacePos = parent.find(' ');
-        if (spacePos != std::string::npos) {
-            std::string firstParent = parent.substr(0, spacePos);
-            std::string secondParent = parent.substr(spacePos + 1);
-            std::cout << "Merge: " << firstParent.substr(0, 7) << " " << secondParent.substr(0, 7) << std::endl;
+    size_t index = 0;
+    for (const auto &entry : files) {
+        for (const auto &match : matches[slots[index++]]) {
+            out << entry.name << ':' << match.first << ':' << match.second << '\n';
         }
+    }
+    out.flush();
+}
 
-        std::cout << "Date: " << timestamp << std::endl;
-        std::cout << message << std::endl
-                  << std::endl;
+/**
+ * Writes a tar archive of the files of the commit named by REVISION to OUTPUTPATH, or to the
+ * command output if it is empty. Blobs go straight from the object store into the archive: the
+ * working tree and staging area are not touched. Whole blobs are read ahead on the thread pool, at
+ * most ARCHIVE_READ_AHEAD files and ARCHIVE_READ_AHEAD_BYTES (reserved before each read starts)
+ * beyond the one being written; chunked blobs are written one chunk at a time.
+ */
+void SomeObj::archive(const std::string &revision, const std::string &outputPath) {
+    Commit commit = Commit::read(resolveRevision(revision));
+    Manifest files = getFilesInCommit(commit.id);
+    std::vector<const Manifest::Entry *> entries;
+    entries.reserve(files.size());
+    for (const auto &entry : files) {
+        entries.push_back(&entry);
+    }
+
+    std::ofstream file;
+    if (!outputPath.empty()) {
+        file.open(outputPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            throw GitliteException("Cannot write " + outputPath + ".");
+        }
+    }
+    TarWriter tar(outputPath.empty() ? out : file);
+
+    // Declared before the pool, which finishes its tasks before they go
+    struct ReadAhead {
+        std::mutex mutex; // guards contents, done and error
+        std::condition_variable ready;
+        std::vector<std::string> contents;
+        std::vector<char> done;
+        std::exception_ptr error;
+    } ahead;
+    ahead.contents.resize(entries.size());
+    ahead.done.resize(entries.size());
+    ObjectStore store;
+
+    // Sizes come from object headers, so a read is counted against the budget
+    // before it starts; chunked blobs are streamed instead of read ahead
+    std::vector<uint64_t> sizes(entries.size());
+    std::vector<std::vector<std::string>> chunkIds(entries.size());
+    size_t bufferedBytes = 0;
+    ThreadPool pool;
+    size_t submitted = 0;
+    auto submitNext = [&] {
+        size_t i = submitted++;
+        if (!chunkIds[i].empty()) {
+            return;
+        }
+        bufferedBytes += sizes[i];
+        pool.submit([&ahead, &store, &entries, i] {
+            std::string content;
+            std::exception_ptr error;
+            try {
+                content = store.read(entries[i]->blobId.hex());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(ahead.mutex);
+            ahead.contents[i] = std::move(content);
+            ahead.done[i] = true;
+            if (error && !ahead.error) {
+                ahead.error = error;
+            }
+            ahead.ready.notify_all();
+        });
+    };
 
-        // For merge commits, follow first parent only
-        if (spacePos != std::string::npos) {
-            currentCommitId = parent.substr(0, spacePos);
-        } else {
-            currentCommitId = parent;
+    Trace::Region region("archive.write");
+    size_t sized = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        while (submitted < entries.size() && submitted <= i + ARCHIVE_READ_AHEAD) {
+            for (; sized <= submitted; ++sized) {
+                sizes[sized] = store.blobSize(entries[sized]->blobId.hex(), &chunkIds[sized]);
+            }
+            if (submitted != i && chunkIds[submitted].empty() &&
+                bufferedBytes + sizes[submitted] > ARCHIVE_READ_AHEAD_BYTES) {
+                break;
+            }
+            submitNext();
+        }
+
+        std::string name(entries[i]->name);
+        if (!chunkIds[i].empty()) {
+            // One chunk in memory at a time, as in ObjectStore::checkoutBlob
+            tar.addFile(name, sizes[i], commit.timestamp);
+            uint64_t left = sizes[i];
+            for (const auto &chunkId : chunkIds[i]) {
+                std::string chunk = store.read(chunkId);
+                if (chunk.size() > left) {
+                    throw GitliteException("Object " + entries[i]->blobId.hex() + " is corrupt.");
+                }
+                tar.write(chunk.data(), chunk.size());
+                left -= chunk.size();
+            }
+            if (left != 0) {
+                throw GitliteException("Object " + entries[i]->blobId.hex() + " is corrupt.");
+            }
+            chunkIds[i].clear();
+            continue;
+        }
+
+        std::string content;
+        {
+            std::unique_lock<std::mutex> lock(ahead.mutex);
+            ahead.ready.wait(lock, [&ahead, i] { return ahead.done[i] || ahead.error; });
+            if (ahead.error) {
+                std::rethrow_exception(ahead.error);
+            }
+            content = std::move(ahead.contents[i]);
+        }
+        bufferedBytes -= sizes[i];
+        tar.addFile(name, content, commit.timestamp);
+    }
+    tar.finish();
+    if (!outputPath.empty() && !file) {
+        throw GitliteException("Cannot write " + outputPath + ".");
+    }
+}
+
+/**
+ * Returns the commit named by REVISION: a branch (including "remote/branch"),
+ * a full or abbreviated commit ID, or HEAD if REVISION is empty.
+ */
+std::string SomeObj::resolveRevision(const std::string &revision) {
+    RefStore refs;
+    if (revision.empty() || revision == "HEAD") {
+        return refs.branchHead(refs.currentBranch());
+    }
+    if (revision.find("..") == std::string::npos) {
+        std::string branchHead = refs.branchHead(revision);
+        if (!branchHead.empty()) {
+            return branchHead;
         }
     }
+    std::string commitId;
+    if (revision.length() == Utils::UID_LENGTH) {
+        commitId = revision;
+    } else if (revision.find_first_not_of("0123456789abcdef") == std::string::npos) {
+        commitId = ObjectStore().findByPrefix(revision);
+    }
+    return Commit::read(commitId).id;
 }
 
 /**
@@ -303,43 +666,24 @@ void SomeObj::log() {
 void SomeObj::globalLog() {
     auto commitFiles = Utils::plainFilenamesIn(".gitlite/objects");
 
+    ObjectStore store;
     for (const auto &commitId : commitFiles) {
-        std::string commitPath = ".gitlite/objects/" + commitId;
-        std::string commitContent = Utils::readContentsAsString(commitPath);
-
-        // Skip if not a commit (blobs don't have "parent " prefix)
-        if (commitContent.substr(0, 7) != "parent ") {
+        if (ObjectStore::isTemporary(commitId)) {
             continue;
         }
+        std::string commitContent = store.read(commitId);
 
-        // Parse commit information
-        std::string timestamp, message;
-        size_t pos = 0;
-
-        pos = commitContent.find("timestamp ");
-        if (pos != std::string::npos) {
-            size_t end = commitContent.find('\n', pos);
-            std::string timestampStr = commitContent.substr(pos + 10, end - pos - 10);
-            std::time_t ts = std::stoll(timestampStr);
-            auto tm = *std::localtime(&ts);
-            std::ostringstream oss;
-            oss << std::put_time(&tm, "%a %b %d %H:%M:%S %Y %z");
-            timestamp = oss.str();
-        }
-
-        pos = commitContent.find("message ");
-        if (pos != std::string::npos) {
-            size_t end = commitContent.find('\n', pos);
-            message = commitContent.substr(pos + 8, end - pos - 8);
+        // Skip if not a commit (blobs don't have "parent " prefix)
+        if (commitContent.compare(0, 7, "parent ") != 0) {
+            continue;
         }
+        Commit commit = Commit::parse(commitId, commitContent);
 
-        // Print commit information
-        std::cout << "===" << std::endl;
-        std::cout << "commit " << commitId << std::endl;
-        std::cout << "Date: " << timestamp << std::endl;
-        std::cout << message << std::endl
-                  << std::endl;
+        out << "===\ncommit " << commitId << '\n'
+            << "Date: " << Commit::formatDate(commit.timestamp) << '\n'
+            << commit.message << "\n\n";
     }
+    out.flush();
 }
 
 /**
@@ -350,9 +694,12 @@ void SomeObj::find(const std::string &commitMessage) {
     bool found = false;
     auto commitFiles = Utils::plainFilenamesIn(".gitlite/objects");
 
+    ObjectStore store;
     for (const auto &commitId : commitFiles) {
-        std::string commitPath = ".gitlite/objects/" + commitId;
-        std::string commitContent = Utils::readContentsAsString(commitPath);
+        if (ObjectStore::isTemporary(commitId)) {
+            continue;
+        }
+        std::string commitContent = store.read(commitId);
 
         // Skip if not a commit
         if (commitContent.substr(0, 7) != "parent ") {
@@ -365,14 +712,14 @@ void SomeObj::find(const std::string &commitMessage) {
             size_t end = commitContent.find('\n', pos);
             std::string message = commitContent.substr(pos + 8, end - pos - 8);
             if (message == commitMessage) {
-                std::cout << commitId << std::endl;
+                out << commitId << std::endl;
                 found = true;
             }
         }
     }
 
     if (!found) {
-        Utils::exitWithMessage("Found no commit with that message.");
+        throw GitliteException("Found no commit with that message.");
     }
 }
 
@@ -382,67 +729,34 @@ void SomeObj::find(const std::string &commitMessage) {
  */
 void SomeObj::checkoutFile(const std::string &filename) {
     // Get current commit
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-
-    checkoutFileInCommit(currentCommitId, filename);
+    RefStore refs;
+    checkoutFileInCommit(refs.branchHead(refs.currentBranch()), filename);
 }
 
 void SomeObj::checkoutFileInCommit(const std::string &commitId, const std::string &filename) {
     // Find full commit ID from short ID
     std::string fullCommitId = commitId;
     if (commitId.length() < 40) {
-        auto commitFiles = Utils::plainFilenamesIn(".gitlite/objects");
-        bool found = false;
-
-        for (const auto &id : commitFiles) {
-            if (id.substr(0, commitId.length()) == commitId) {
-                fullCommitId = id;
-                found = true;
-                break;
-            }
-        }
-
-        if (!found) {
-            Utils::exitWithMessage("No commit with that id exists.");
+        fullCommitId = ObjectStore().findByPrefix(commitId);
+        if (fullCommitId.empty()) {
+            throw GitliteException("No commit with that id exists.");
         }
     }
 
     // Check if commit exists
-    std::string commitPath = ".gitlite/objects/" + fullCommitId;
-    if (!Utils::exists(commitPath)) {
-        Utils::exitWithMessage("No commit with that id exists.");
+    ObjectStore store;
+    if (!store.contains(fullCommitId)) {
+        throw GitliteException("No commit with that id exists.");
     }
 
-    std::string commitContent = Utils::readContentsAsString(commitPath);
-
     // Find file in commit
-    size_t filesPos = commitContent.find("files ");
-    if (filesPos == std::string::npos) {
-        Utils::exitWithMessage("File does not exist in that commit.");
-    }
-
-    std::string filesSection = commitContent.substr(filesPos + 6);
-    size_t newlinePos = filesSection.find('\n');
-    if (newlinePos != std::string::npos) {
-        filesSection = filesSection.substr(0, newlinePos);
+    ObjectId blobId = getFilesInCommit(fullCommitId).blobId(filename);
+    if (blobId.isNull()) {
+        throw GitliteException("File does not exist in that commit.");
     }
 
-    // Parse files section
-    size_t filePos = filesSection.find(filename + ":");
-    if (filePos == std::string::npos) {
-        Utils::exitWithMessage("File does not exist in that commit.");
-    }
-
-    size_t colonPos = filesSection.find(':', filePos);
-    size_t semicolonPos = filesSection.find(';', colonPos);
-    std::string blobId = filesSection.substr(colonPos + 1, semicolonPos - colonPos - 1);
-
     // Restore file content
-    std::string blobPath = ".gitlite/objects/" + blobId;
-    std::string fileContent = Utils::readContentsAsString(blobPath);
-    Utils::writeContents(filename, fileContent);
+    store.checkoutBlob(blobId.hex(), filename);
 }
 
 /**
@@ -450,30 +764,39 @@ void SomeObj::checkoutFileInCommit(const std::string &commitId, const std::strin
  * Updates files in the working directory to match the commit at the head of the given branch.
  * Updates HEAD to point to the new branch.
  * Checks for untracked files that would be overwritten and aborts if any are found.
+ * Files outside the sparse-checkout set are neither written nor deleted.
  */
 void SomeObj::checkoutBranch(const std::string &branchName) {
+    StagingLock lock(*this);
+
     // Check if branch exists
-    std::string branchPath = ".gitlite/refs/heads/" + branchName;
-    if (!Utils::exists(branchPath)) {
-        Utils::exitWithMessage("No such branch exists.");
+    RefStore refs;
+    std::string targetCommitId = refs.branchHead(branchName);
+    if (targetCommitId.empty()) {
+        throw GitliteException("No such branch exists.");
     }
 
     // Get current branch
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
+    std::string currentBranch = refs.currentBranch();
 
     if (currentBranch == branchName) {
-        Utils::exitWithMessage("No need to checkout the current branch.");
+        throw GitliteException("No need to checkout the current branch.");
     }
 
-    // Get commit IDs
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-    std::string targetCommitId = Utils::readContentsAsString(branchPath);
+    // Held until HEAD moves, so that no other worktree takes the branch meanwhile
+    LockFile worktreesLock(Worktree::lockPath());
+    std::string otherWorktree = Worktree::checkedOutElsewhere(branchName);
+    if (!otherWorktree.empty()) {
+        throw GitliteException("Branch " + branchName + " is already checked out at " + otherWorktree + ".");
+    }
+
+    std::string currentCommitId = refs.branchHead(currentBranch);
 
     // Check for untracked files that would be overwritten
-    auto currentFiles = Utils::plainFilenamesIn(".");
-    auto targetCommitFiles = getFilesInCommit(targetCommitId);
-    auto currentCommitFiles = getFilesInCommit(currentCommitId);
+    auto currentFiles = listWorkingFiles();
+    SparseCheckout sparse = SparseCheckout::load();
+    Manifest targetCommitFiles = getFilesInCommit(targetCommitId);
+    Manifest currentCommitFiles = getFilesInCommit(currentCommitId);
 
     for (const auto &file : currentFiles) {
         if (file == ".gitlite" || file.substr(0, 9) == ".gitlite/") {
@@ -482,36 +805,37 @@ void SomeObj::checkoutBranch(const std::string &branchName) {
 
         // Check if file exists in working directory and would be overwritten by checkout
         // AND it's not currently tracked in the current branch
-        if (targetCommitFiles.find(file) != targetCommitFiles.end() &&
-            currentCommitFiles.find(file) == currentCommitFiles.end()) {
+        if (targetCommitFiles.contains(file) && !currentCommitFiles.contains(file) && sparse.includes(file)) {
             // Also check if it's not staged for addition
             bool isStaged = Utils::isDirectory(".gitlite/staging") &&
                             Utils::exists(".gitlite/staging/" + file) &&
                             Utils::readContentsAsString(".gitlite/staging/" + file) != "DELETE";
 
             if (!isStaged) {
-                Utils::exitWithMessage("There is an untracked file in the way; delete it, or add and commit it first.");
+                throw GitliteException("There is an untracked file in the way; delete it, or add and commit it first.");
             }
         }
     }
 
-    // Restore files from target branch
-    for (const auto &pair : targetCommitFiles) {
-        std::string blobId = pair.second;
-        std::string blobPath = ".gitlite/objects/" + blobId;
-        std::string content = Utils::readContentsAsString(blobPath);
-        Utils::writeContents(pair.first, content);
+    // Restore files from target branch, within the sparse-checkout set
+    Trace::Region writeRegion("checkout.write_worktree");
+    ObjectStore store;
+    for (const auto &entry : targetCommitFiles) {
+        if (sparse.includes(entry.name)) {
+            store.checkoutBlob(entry.blobId.hex(), std::string(entry.name));
+        }
     }
 
     // Delete files that are tracked in current branch but not in target branch
-    for (const auto &pair : currentCommitFiles) {
-        if (targetCommitFiles.find(pair.first) == targetCommitFiles.end()) {
-            Utils::restrictedDelete(pair.first);
+    Manifest::Join join({&currentCommitFiles, &targetCommitFiles});
+    while (join.next()) {
+        if (!join.has(1) && sparse.includes(join.name())) {
+            Utils::restrictedDelete(std::string(join.name()));
         }
     }
 
     // Update HEAD
-    Utils::writeContents(".gitlite/HEAD", "ref: refs/heads/" + branchName);
+    RefStore().write("HEAD", "ref: refs/heads/" + branchName);
 
     // Clear staging area
     if (Utils::isDirectory(".gitlite/staging")) {
@@ -522,162 +846,222 @@ void SomeObj::checkoutBranch(const std::string &branchName) {
 
 /**
  * Displays a full repository status snapshot.
- * Steps: (1) read HEAD to identify the current branch and print all branches sorted (current marked with *);
- * (2) list staged additions and staged deletions (entries marked with "DELETE");
- * (3) compute "Modifications Not Staged" by comparing working tree vs tracked blobs vs staged blobs,
- *     flagging content changes or deletions that are not already staged;
- * (4) list untracked files that are neither staged nor tracked in the current commit.
- * Mirrors the Git status layout so the user sees what will be committed and what remains to stage.
+ * Prints the report from getStatus() in the Git status layout: branches (current marked with *),
+ * staged files, removed files, modifications not staged for commit, and untracked files.
  */
 void SomeObj::status() {
-    // Current branch name derives from HEAD ref line: "ref: refs/heads/<branch>"
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
+    StatusReport report = getStatus();
 
     // === Branches ===
-    // List branches alphabetically and mark the current one with '*'
-    std::cout << "=== Branches ===" << std::endl;
-    auto branches = Utils::plainFilenamesIn(".gitlite/refs/heads");
-    std::sort(branches.begin(), branches.end());
-
-    for (const auto &branch : branches) {
-        if (branch == currentBranch) {
-            std::cout << "*" << branch << std::endl;
+    out << "=== Branches ===" << std::endl;
+    for (const auto &branch : report.branches) {
+        if (branch == report.currentBranch) {
+            out << "*" << branch << std::endl;
         } else {
-            std::cout << branch << std::endl;
+            out << branch << std::endl;
         }
     }
 
     // === Staged Files ===
-    // Show files staged for addition/update (anything not marked DELETE)
-    std::cout << std::endl
-              << "=== Staged Files ===" << std::endl;
-    if (Utils::isDirectory(".gitlite/staging")) {
-        auto stagedFiles = Utils::plainFilenamesIn(".gitlite/staging");
-        std::sort(stagedFiles.begin(), stagedFiles.end());
-
-        for (const auto &file : stagedFiles) {
-            std::string content = Utils::readContentsAsString(".gitlite/staging/" + file);
-            if (content != "DELETE") {
-                std::cout << file << std::endl;
-            }
-        }
+    out << std::endl
+        << "=== Staged Files ===" << std::endl;
+    for (const auto &file : report.staged) {
+        out << file << std::endl;
     }
 
     // === Removed Files ===
-    // Show files staged for removal (DELETE markers in staging)
-    std::cout << std::endl
-              << "=== Removed Files ===" << std::endl;
-    if (Utils::isDirectory(".gitlite/staging")) {
-        auto stagedFiles = Utils::plainFilenamesIn(".gitlite/staging");
-        std::sort(stagedFiles.begin(), stagedFiles.end());
-
-        for (const auto &file : stagedFiles) {
-            std::string content = Utils::readContentsAsString(".gitlite/staging/" + file);
-            if (content == "DELETE") {
-                std::cout << file << std::endl;
-            }
-        }
+    out << std::endl
+        << "=== Removed Files ===" << std::endl;
+    for (const auto &file : report.removed) {
+        out << file << std::endl;
     }
 
     // === Modifications Not Staged For Commit ===
-    // Compare working tree vs tracked vs staged to find edits not yet staged
-    std::cout << std::endl
-              << "=== Modifications Not Staged For Commit ===" << std::endl;
+    out << std::endl
+        << "=== Modifications Not Staged For Commit ===" << std::endl;
+    for (const auto &p : report.modifications) {
+        out << p.first << " (" << p.second << ")" << std::endl;
+    }
 
-    std::map<std::string, std::string> modifications;
-    
-    auto workingFiles = Utils::plainFilenamesIn(".");
-    std::set<std::string> workingSet;
-    for(const auto& f : workingFiles) {
-        if (f != ".gitlite" && f.find(".gitlite/") != 0) {
-            workingSet.insert(f);
-        }
+    // === Untracked Files ===
+    out << std::endl
+        << "=== Untracked Files ===" << std::endl;
+    for (const auto &file : report.untracked) {
+        out << file << std::endl;
     }
-    
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-    auto trackedFiles = getFilesInCommit(currentCommitId);
-    
-    std::vector<std::string> stagedFiles;
-    if (Utils::isDirectory(".gitlite/staging")) {
-        stagedFiles = Utils::plainFilenamesIn(".gitlite/staging");
+}
+
+/**
+ * Computes the repository status.
+ * Steps: (1) read HEAD to identify the current branch and list all branches sorted;
+ * (2) list staged additions and staged deletions (entries marked with "DELETE");
+ * (3) compute "Modifications Not Staged" by comparing working tree vs tracked blobs vs staged blobs,
+ *     flagging content changes or deletions that are not already staged;
+ * (4) list untracked files that are neither staged nor tracked in the current commit, nor ignored
+ *     by .gitliteignore.
+ * Steps (3) and (4) are one merge join over the sorted file lists; the content comparisons
+ * run on a thread pool when there are many files. Paths outside the sparse-checkout set are
+ * skipped in both: they are not expected in the working tree.
+ */
+StatusReport SomeObj::getStatus() {
+    StatusReport report;
+    RefStore refs;
+
+    // Current branch name derives from HEAD ref line: "ref: refs/heads/<branch>"
+    {
+        Trace::Region region("status.parse_head");
+        report.currentBranch = refs.currentBranch();
     }
-    std::set<std::string> stagedSet(stagedFiles.begin(), stagedFiles.end());
-    
-    std::set<std::string> allFiles;
-    for(const auto& f : workingSet) allFiles.insert(f);
-    for(const auto& p : trackedFiles) allFiles.insert(p.first);
-    for(const auto& f : stagedFiles) allFiles.insert(f);
-    
-    for(const auto& file : allFiles) {
-        bool inWorking = workingSet.count(file);
-        bool inTracked = trackedFiles.count(file);
-        bool inStaged = stagedSet.count(file);
-        
-        std::string stagedContent = "";
-        if (inStaged) {
-            stagedContent = Utils::readContentsAsString(".gitlite/staging/" + file);
+    const std::string &currentBranch = report.currentBranch;
+
+    // Branches alphabetically
+    report.branches = refs.localBranches();
+    std::sort(report.branches.begin(), report.branches.end());
+
+    // Staged additions/updates and removals (DELETE markers in staging), read once
+    std::map<std::string, std::string> staged;
+    for (const auto &file : Utils::plainFilenamesIn(".gitlite/staging")) {
+        std::string content = Utils::readContentsAsString(".gitlite/staging/" + file);
+        (content != "DELETE" ? report.staged : report.removed).push_back(file);
+        staged.emplace(file, std::move(content));
+    }
+
+    WorktreeSnapshot worktree;
+    {
+        Trace::Region region("status.scan_worktree");
+        worktree.load();
+    }
+    const std::set<std::string> &workingSet = worktree.files();
+
+    std::string currentCommitId = refs.branchHead(currentBranch);
+    Manifest trackedFiles = getFilesInCommit(currentCommitId);
+    IgnoreRules ignore = IgnoreRules::load();
+    SparseCheckout sparse = SparseCheckout::load();
+
+    // One pass over the union of working, tracked and staged files, which
+    // are all sorted: a three-way merge join
+    enum Kind : char { CLEAN, MODIFIED, DELETED, UNTRACKED };
+    struct FileState {
+        std::string name;
+        bool inWorking;
+        const Manifest::Entry *tracked;
+        const std::string *stagedContent;
+        Kind kind = CLEAN;
+    };
+    std::vector<FileState> files;
+    {
+        Trace::Region region("status.join");
+        auto working = workingSet.begin();
+        auto tracked = trackedFiles.begin();
+        auto stagedEntry = staged.begin();
+        while (working != workingSet.end() || tracked != trackedFiles.end() || stagedEntry != staged.end()) {
+            std::string_view name;
+            bool first = true;
+            auto consider = [&name, &first](std::string_view candidate) {
+                if (first || candidate < name) {
+                    name = candidate;
+                    first = false;
+                }
+            };
+            if (working != workingSet.end()) {
+                consider(*working);
+            }
+            if (tracked != trackedFiles.end()) {
+                consider(tracked->name);
+            }
+            if (stagedEntry != staged.end()) {
+                consider(stagedEntry->first);
+            }
+
+            FileState state{std::string(name), false, nullptr, nullptr};
+            if (working != workingSet.end() && *working == name) {
+                state.inWorking = true;
+                ++working;
+            }
+            if (tracked != trackedFiles.end() && tracked->name == name) {
+                state.tracked = &*tracked++;
+            }
+            if (stagedEntry != staged.end() && stagedEntry->first == name) {
+                state.stagedContent = &stagedEntry->second;
+                ++stagedEntry;
+            }
+            files.push_back(std::move(state));
         }
-        
-        if (inWorking && inTracked && !inStaged) {
+    }
+
+    // Whether working file FILE differs from blob BLOBID.  With the fsmonitor
+    // daemon running, hashes of unchanged files come from its snapshot.
+    ObjectStore store;
+    auto differs = [&worktree, &store](const std::string &file, const std::string &blobId) {
+        if (worktree.monitored()) {
+            return worktree.hash(file) != blobId;
+        }
+        return store.contains(blobId) && Utils::readContentsAsString(file) != store.readBlob(blobId);
+    };
+
+    // Classify each file: comparing contents is the expensive part, so
+    // batches of files run on the thread pool.  Each file's result has its
+    // own slot, so the report comes out sorted whatever the schedule.
+    auto classify = [&differs, &ignore, &sparse](FileState &file) {
+        if (!sparse.includes(file.name)) {
+            return; // not checked out: neither compared nor untracked
+        }
+        bool inStaged = file.stagedContent != nullptr;
+        bool stagedDelete = inStaged && *file.stagedContent == "DELETE";
+        if (file.inWorking && file.tracked && !inStaged) {
             // Tracked file changed in working tree but not staged
-            std::string workingContent = Utils::readContentsAsString(file);
-            std::string trackedBlob = trackedFiles[file];
-            if (Utils::exists(".gitlite/objects/" + trackedBlob)) {
-                std::string trackedContent = Utils::readContentsAsString(".gitlite/objects/" + trackedBlob);
-                if (workingContent != trackedContent) {
-                    modifications[file] = "modified";
-                }
+            if (differs(file.name, file.tracked->blobId.hex())) {
+                file.kind = MODIFIED;
             }
-        } else if (inWorking && inStaged && stagedContent != "DELETE") {
+        } else if (file.inWorking && inStaged && !stagedDelete) {
             // Staged version differs from working tree (edited after staging)
-            std::string workingContent = Utils::readContentsAsString(file);
-            std::string stagedBlob = stagedContent;
-            if (Utils::exists(".gitlite/objects/" + stagedBlob)) {
-                std::string stagedBlobContent = Utils::readContentsAsString(".gitlite/objects/" + stagedBlob);
-                if (workingContent != stagedBlobContent) {
-                    modifications[file] = "modified";
-                }
+            if (differs(file.name, *file.stagedContent)) {
+                file.kind = MODIFIED;
             }
-        } else if (!inWorking && inStaged && stagedContent != "DELETE") {
+        } else if (!file.inWorking && inStaged && !stagedDelete) {
             // Tracked/staged file removed from working tree but not staged as delete
-            modifications[file] = "deleted";
-        } else if (!inWorking && !inStaged && inTracked) {
+            file.kind = DELETED;
+        } else if (!file.inWorking && !inStaged && file.tracked) {
             // Tracked file missing and not staged -> deleted but unstaged
-            modifications[file] = "deleted";
+            file.kind = DELETED;
+        } else if (file.inWorking && !inStaged && !file.tracked && !ignore.ignored(file.name)) {
+            // Untracked: neither staged nor tracked in HEAD, nor ignored
+            file.kind = UNTRACKED;
         }
-    }
-    
-    for(const auto& p : modifications) {
-        std::cout << p.first << " (" << p.second << ")" << std::endl;
-    }
-
-    // === Untracked Files ===
-    // Files neither staged nor tracked in HEAD
-    std::cout << std::endl
-              << "=== Untracked Files ===" << std::endl;
+    };
     {
-        auto workingFiles = Utils::plainFilenamesIn(".");
-        std::sort(workingFiles.begin(), workingFiles.end());
-
-        // Get current commit files
-        std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-        auto trackedFiles = getFilesInCommit(currentCommitId);
-
-        for (const auto &file : workingFiles) {
-            if (file == ".gitlite" || file.substr(0, 9) == ".gitlite/") {
-                continue;
+        Trace::Region region("status.compare");
+        if (files.size() < PARALLEL_STATUS_THRESHOLD) {
+            for (auto &file : files) {
+                classify(file);
             }
-
-            // Check if file is not staged and not tracked
-            bool isStaged = Utils::exists(".gitlite/staging/" + file);
-            bool isTracked = trackedFiles.find(file) != trackedFiles.end();
-
-            if (!isStaged && !isTracked) {
-                std::cout << file << std::endl;
+        } else {
+            ThreadPool pool;
+            size_t batchSize = std::max<size_t>(1, files.size() / (pool.size() * 8) + 1);
+            for (size_t begin = 0; begin < files.size(); begin += batchSize) {
+                size_t end = std::min(files.size(), begin + batchSize);
+                pool.submit([&files, &classify, begin, end] {
+                    for (size_t i = begin; i < end; ++i) {
+                        classify(files[i]);
+                    }
+                });
             }
+            pool.wait();
+        }
+    }
+
+    for (auto &file : files) {
+        if (file.kind == MODIFIED) {
+            report.modifications.emplace_hint(report.modifications.end(), std::move(file.name), "modified");
+        } else if (file.kind == DELETED) {
+            report.modifications.emplace_hint(report.modifications.end(), std::move(file.name), "deleted");
+        } else if (file.kind == UNTRACKED) {
+            report.untracked.push_back(std::move(file.name));
         }
     }
+    worktree.save();
+
+    return report;
 }
 
 /**
@@ -685,18 +1069,14 @@ void SomeObj::status() {
  * The new branch points to the current commit.
  */
 void SomeObj::branch(const std::string &branchName) {
-    std::string branchPath = ".gitlite/refs/heads/" + branchName;
-    if (Utils::exists(branchPath)) {
-        Utils::exitWithMessage("A branch with that name already exists.");
-    }
-
-    // Get current commit
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
+    RefStore refs;
+    std::string currentCommitId = refs.branchHead(refs.currentBranch());
 
-    // Create new branch pointing to current commit
-    Utils::writeContents(branchPath, currentCommitId);
+    // Create new branch pointing to current commit, unless one exists (or is
+    // being created by another process at the same time)
+    if (!refs.compareAndSwap(RefStore::branchRef(branchName), "", currentCommitId)) {
+        throw GitliteException("A branch with that name already exists.");
+    }
 }
 
 /**
@@ -705,20 +1085,26 @@ void SomeObj::branch(const std::string &branchName) {
  * Aborts if the branch does not exist or if it is the current branch.
  */
 void SomeObj::rmBranch(const std::string &branchName) {
-    std::string branchPath = ".gitlite/refs/heads/" + branchName;
-    if (!Utils::exists(branchPath)) {
-        Utils::exitWithMessage("A branch with that name does not exist.");
+    RefStore refs;
+    std::string branchRef = RefStore::branchRef(branchName);
+    std::string branchHead = refs.read(branchRef);
+    if (branchHead.empty()) {
+        throw GitliteException("A branch with that name does not exist.");
     }
 
     // Check if it's the current branch
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-
-    if (currentBranch == branchName) {
-        Utils::exitWithMessage("Cannot remove the current branch.");
+    if (refs.currentBranch() == branchName) {
+        throw GitliteException("Cannot remove the current branch.");
+    }
+    std::string otherWorktree = Worktree::checkedOutElsewhere(branchName);
+    if (!otherWorktree.empty()) {
+        throw GitliteException("Branch " + branchName + " is checked out at " + otherWorktree + ".");
     }
 
-    Utils::restrictedDelete(branchPath);
+    // Deleting a branch that just moved would silently drop its new commits
+    if (!refs.remove(branchRef, branchHead)) {
+        throw GitliteException("Branch " + branchName + " is being updated by another process; try again.");
+    }
 }
 
 /**
@@ -729,40 +1115,32 @@ void SomeObj::rmBranch(const std::string &branchName) {
  * clears the staging area so the working directory exactly mirrors the chosen commit.
  */
 void SomeObj::reset(const std::string &commitId) {
+    StagingLock lock(*this);
+
     // Resolve abbreviated commit ID to full 40-char SHA if needed
     std::string fullCommitId = commitId;
     if (commitId.length() < 40) {
-        auto commitFiles = Utils::plainFilenamesIn(".gitlite/objects");
-        bool found = false;
-
-        for (const auto &id : commitFiles) {
-            if (id.substr(0, commitId.length()) == commitId) {
-                fullCommitId = id;
-                found = true;
-                break;
-            }
-        }
-
-        if (!found) {
-            Utils::exitWithMessage("No commit with that id exists.");
+        fullCommitId = ObjectStore().findByPrefix(commitId);
+        if (fullCommitId.empty()) {
+            throw GitliteException("No commit with that id exists.");
         }
     }
 
-    // Ensure target commit object exists locally
-    std::string commitPath = ".gitlite/objects/" + fullCommitId;
-    if (!Utils::exists(commitPath)) {
-        Utils::exitWithMessage("No commit with that id exists.");
+    // Ensure target commit object exists (here or in an alternate)
+    if (!ObjectStore().contains(fullCommitId)) {
+        throw GitliteException("No commit with that id exists.");
     }
 
     // Read current branch and its head commit
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
+    RefStore refs;
+    std::string currentBranch = refs.currentBranch();
+    std::string currentCommitId = refs.branchHead(currentBranch);
 
     // Protect untracked files that would be overwritten by files from target commit
-    auto currentFiles = Utils::plainFilenamesIn(".");
-    auto targetCommitFiles = getFilesInCommit(fullCommitId);
-    auto currentCommitFiles = getFilesInCommit(currentCommitId);
+    auto currentFiles = listWorkingFiles();
+    SparseCheckout sparse = SparseCheckout::load();
+    Manifest targetCommitFiles = getFilesInCommit(fullCommitId);
+    Manifest currentCommitFiles = getFilesInCommit(currentCommitId);
 
     for (const auto &file : currentFiles) {
         if (file == ".gitlite" || file.substr(0, 9) == ".gitlite/") {
@@ -771,36 +1149,40 @@ void SomeObj::reset(const std::string &commitId) {
 
         // Check if file exists in working directory and would be overwritten by reset
         // AND it's not currently tracked in current branch
-        if (targetCommitFiles.find(file) != targetCommitFiles.end() &&
-            currentCommitFiles.find(file) == currentCommitFiles.end()) {
+        if (targetCommitFiles.contains(file) && !currentCommitFiles.contains(file) && sparse.includes(file)) {
             // Also check if it's not staged for addition
             bool isStaged = Utils::isDirectory(".gitlite/staging") &&
                             Utils::exists(".gitlite/staging/" + file) &&
                             Utils::readContentsAsString(".gitlite/staging/" + file) != "DELETE";
 
             if (!isStaged) {
-                Utils::exitWithMessage("There is an untracked file in the way; delete it, or add and commit it first.");
+                throw GitliteException("There is an untracked file in the way; delete it, or add and commit it first.");
             }
         }
     }
 
-    // Restore files from target commit (write all blobs present in target)
-    for (const auto &pair : targetCommitFiles) {
-        std::string blobId = pair.second;
-        std::string blobPath = ".gitlite/objects/" + blobId;
-        std::string content = Utils::readContentsAsString(blobPath);
-        Utils::writeContents(pair.first, content);
+    // Move branch ref to the target commit, first, so that losing a race
+    // with another process leaves the working tree untouched
+    if (!refs.compareAndSwap(RefStore::branchRef(currentBranch), currentCommitId, fullCommitId)) {
+        throw GitliteException("Branch " + currentBranch + " is being updated by another process; try again.");
     }
 
-    // Remove files that existed in current commit but not in target commit
-    for (const auto &pair : currentCommitFiles) {
-        if (targetCommitFiles.find(pair.first) == targetCommitFiles.end()) {
-            Utils::restrictedDelete(pair.first);
+    // Restore files from target commit (write all blobs present in target, within the
+    // sparse-checkout set)
+    ObjectStore store;
+    for (const auto &entry : targetCommitFiles) {
+        if (sparse.includes(entry.name)) {
+            store.checkoutBlob(entry.blobId.hex(), std::string(entry.name));
         }
     }
 
-    // Move branch ref to the target commit
-    Utils::writeContents(".gitlite/refs/heads/" + currentBranch, fullCommitId);
+    // Remove files that existed in current commit but not in target commit
+    Manifest::Join join({&currentCommitFiles, &targetCommitFiles});
+    while (join.next()) {
+        if (!join.has(1) && sparse.includes(join.name())) {
+            Utils::restrictedDelete(std::string(join.name()));
+        }
+    }
 
     // Clear staging to ensure clean state matching the reset commit
     if (Utils::isDirectory(".gitlite/staging")) {
@@ -818,62 +1200,72 @@ void SomeObj::reset(const std::string &commitId) {
  *    using staged markers and conflict blobs with <<<<<<< separators when both sides diverge.
  *  - Stage the computed results, then write a merge commit with two parents. Conflicts surface as messages but the
  *    merge commit is still created once conflicts are staged, matching the project spec.
+ *  - Outside the sparse-checkout set results are staged without being written to the working tree; only conflicted
+ *    files are written there, so that they can be resolved.
  */
 void SomeObj::merge(const std::string &branchName) {
     if (!Utils::isDirectory(".gitlite")) {
-        Utils::exitWithMessage("Not in an initialized Gitlite directory.");
+        throw GitliteException("Not in an initialized Gitlite directory.");
     }
 
-    std::string branchPath = ".gitlite/refs/heads/" + branchName;
-    if (!Utils::exists(branchPath)) {
-        Utils::exitWithMessage("A branch with that name does not exist.");
+    StagingLock lock(*this);
+    RefStore refs;
+    std::string givenCommitId = refs.branchHead(branchName);
+    if (givenCommitId.empty()) {
+        throw GitliteException("A branch with that name does not exist.");
     }
 
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
+    std::string currentBranch = refs.currentBranch();
     if (branchName == currentBranch) {
-        Utils::exitWithMessage("Cannot merge a branch with itself.");
+        throw GitliteException("Cannot merge a branch with itself.");
     }
 
     // Staging must be clean before merge
     if (Utils::isDirectory(".gitlite/staging") && !Utils::plainFilenamesIn(".gitlite/staging").empty()) {
-        Utils::exitWithMessage("You have uncommitted changes.");
+        throw GitliteException("You have uncommitted changes.");
     }
 
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
-    std::string givenCommitId = Utils::readContentsAsString(branchPath);
-    std::string splitPointId = findSplitPoint(currentCommitId, givenCommitId);
+    std::string currentCommitId = refs.branchHead(currentBranch);
+    std::string splitPointId;
+    {
+        Trace::Region region("merge.split_point");
+        splitPointId = findSplitPoint(currentCommitId, givenCommitId);
+    }
 
     // Given is ancestor: nothing to merge
     if (splitPointId == givenCommitId) {
-        std::cout << "Given branch is an ancestor of the current branch." << std::endl;
+        out << "Given branch is an ancestor of the current branch." << std::endl;
         return;
     }
 
     // Current is ancestor: fast-forward to given
     if (splitPointId == currentCommitId) {
         reset(givenCommitId);
-        std::cout << "Current branch fast-forwarded." << std::endl;
+        out << "Current branch fast-forwarded." << std::endl;
         return;
     }
 
-    auto currentCommitFiles = getFilesInCommit(currentCommitId);
-    auto givenCommitFiles = getFilesInCommit(givenCommitId);
-    auto splitPointFiles = getFilesInCommit(splitPointId);
+    Manifest currentCommitFiles = getFilesInCommit(currentCommitId);
+    Manifest givenCommitFiles = getFilesInCommit(givenCommitId);
+    Manifest splitPointFiles = getFilesInCommit(splitPointId);
 
-    auto workingFiles = Utils::plainFilenamesIn(".");
-    for (const auto &file : workingFiles) {
-        if (file == ".gitlite" || file.rfind(".gitlite/", 0) == 0) {
-            continue;
-        }
-        // If an untracked file would be overwritten by given branch content, abort
-        bool trackedInCurrent = currentCommitFiles.find(file) != currentCommitFiles.end();
-        bool stagedForAdd = Utils::isDirectory(".gitlite/staging") &&
-                            Utils::exists(".gitlite/staging/" + file) &&
-                            Utils::readContentsAsString(".gitlite/staging/" + file) != "DELETE";
-        bool willWriteFromGiven = givenCommitFiles.find(file) != givenCommitFiles.end();
-        if (!trackedInCurrent && !stagedForAdd && willWriteFromGiven) {
-            Utils::exitWithMessage("There is an untracked file in the way; delete it, or add and commit it first.");
+    auto workingFiles = listWorkingFiles();
+    SparseCheckout sparse = SparseCheckout::load();
+    {
+        Trace::Region region("merge.untracked_check");
+        for (const auto &file : workingFiles) {
+            if (file == ".gitlite" || file.rfind(".gitlite/", 0) == 0) {
+                continue;
+            }
+            // If an untracked file would be overwritten by given branch content, abort
+            bool trackedInCurrent = currentCommitFiles.contains(file);
+            bool stagedForAdd = Utils::isDirectory(".gitlite/staging") &&
+                                Utils::exists(".gitlite/staging/" + file) &&
+                                Utils::readContentsAsString(".gitlite/staging/" + file) != "DELETE";
+            bool willWriteFromGiven = givenCommitFiles.contains(file) && sparse.includes(file);
+            if (!trackedInCurrent && !stagedForAdd && willWriteFromGiven) {
+                throw GitliteException("There is an untracked file in the way; delete it, or add and commit it first.");
+            }
         }
     }
 
@@ -883,122 +1275,110 @@ void SomeObj::merge(const std::string &branchName) {
     }
     Utils::createDirectories(".gitlite/staging");
 
-    auto ensureBlob = [](const std::string &content) {
+    ObjectStore store;
+    auto ensureBlob = [&store](const std::string &content) {
         std::string blobId = Utils::sha1(content);
-        std::string blobPath = ".gitlite/objects/" + blobId;
-        if (!Utils::exists(blobPath)) {
-            Utils::writeContents(blobPath, content);
-        }
+        store.writeBlob(blobId, content);
         return blobId;
     };
 
-    auto isModified = [](const std::map<std::string, std::string> &branchFiles,
-                         const std::map<std::string, std::string> &splitFiles,
-                         const std::string &name) {
-        bool inSplit = splitFiles.find(name) != splitFiles.end();
-        bool inBranch = branchFiles.find(name) != branchFiles.end();
+    // A side modified a file if it differs from the split point (added and
+    // deleted count as modified)
+    auto isModified = [](bool inBranch, const ObjectId &branchBlob, bool inSplit, const ObjectId &splitBlob) {
         if (!inSplit) return inBranch;
         if (!inBranch) return true;
-        return splitFiles.at(name) != branchFiles.at(name);
+        return splitBlob != branchBlob;
     };
 
-    std::set<std::string> allFiles;
-    for (const auto &p : splitPointFiles) allFiles.insert(p.first);
-    for (const auto &p : currentCommitFiles) allFiles.insert(p.first);
-    for (const auto &p : givenCommitFiles) allFiles.insert(p.first);
-
     bool hasConflicts = false;
-    for (const auto &name : allFiles) {
-        bool inSplit = splitPointFiles.find(name) != splitPointFiles.end();
-        bool inCurrent = currentCommitFiles.find(name) != currentCommitFiles.end();
-        bool inGiven = givenCommitFiles.find(name) != givenCommitFiles.end();
-
-        std::string splitBlob = inSplit ? splitPointFiles.at(name) : "";
-        std::string curBlob = inCurrent ? currentCommitFiles.at(name) : "";
-        std::string givBlob = inGiven ? givenCommitFiles.at(name) : "";
-
-        bool modCur = isModified(currentCommitFiles, splitPointFiles, name);
-        bool modGiv = isModified(givenCommitFiles, splitPointFiles, name);
-
-        auto stageBlobFromGiven = [&](const std::string &blob) {
-            std::string content = Utils::readContentsAsString(".gitlite/objects/" + blob);
-            Utils::writeContents(name, content);
-            Utils::writeContents(".gitlite/staging/" + name, blob);
-        };
-
-        bool handled = false; // true means no conflict and staged outcome decided
-
-        if (inSplit) {
-            if (inCurrent && inGiven) {
-                if (!modCur && modGiv) {
-                    stageBlobFromGiven(givBlob);
-                    handled = true;
-                } else if (modCur && !modGiv) {
-                    handled = true; // keep current
-                } else if (curBlob == givBlob) {
-                    handled = true; // same change
+    {
+        Trace::Region region("merge.three_way");
+        Manifest::Join join({&splitPointFiles, &currentCommitFiles, &givenCommitFiles});
+        while (join.next()) {
+            std::string name(join.name());
+            bool inSplit = join.has(0);
+            bool inCurrent = join.has(1);
+            bool inGiven = join.has(2);
+
+            ObjectId splitBlob = join.blobId(0);
+            ObjectId curBlob = join.blobId(1);
+            ObjectId givBlob = join.blobId(2);
+
+            bool modCur = isModified(inCurrent, curBlob, inSplit, splitBlob);
+            bool modGiv = isModified(inGiven, givBlob, inSplit, splitBlob);
+
+            auto stageBlobFromGiven = [&](const ObjectId &blob) {
+                if (sparse.includes(name)) {
+                    store.checkoutBlob(blob.hex(), name);
                 }
-            } else if (inCurrent && !inGiven) {
-                if (!modCur) {
-                    if (Utils::exists(name)) {
-                        Utils::restrictedDelete(name);
+                Utils::writeContents(".gitlite/staging/" + name, blob.hex());
+            };
+
+            bool handled = false; // true means no conflict and staged outcome decided
+
+            if (inSplit) {
+                if (inCurrent && inGiven) {
+                    if (!modCur && modGiv) {
+                        stageBlobFromGiven(givBlob);
+                        handled = true;
+                    } else if (modCur && !modGiv) {
+                        handled = true; // keep current
+                    } else if (curBlob == givBlob) {
+                        handled = true; // same change
                     }
-                    Utils::writeContents(".gitlite/staging/" + name, "DELETE");
-                    handled = true;
-                }
-            } else if (!inCurrent && inGiven) {
-                if (!modGiv) {
-                    // File removed in current, unchanged in given -> keep deletion
-                    if (Utils::exists(name)) {
-                        Utils::restrictedDelete(name);
+                } else if (inCurrent && !inGiven) {
+                    if (!modCur) {
+                        if (sparse.includes(name) && Utils::exists(name)) {
+                            Utils::restrictedDelete(name);
+                        }
+                        Utils::writeContents(".gitlite/staging/" + name, "DELETE");
+                        handled = true;
                     }
-                    handled = true;
+                } else if (!inCurrent && inGiven) {
+                    if (!modGiv) {
+                        // File removed in current, unchanged in given -> keep deletion
+                        if (sparse.includes(name) && Utils::exists(name)) {
+                            Utils::restrictedDelete(name);
+                        }
+                        handled = true;
+                    }
+                } else {
+                    handled = true; // deleted in both
                 }
             } else {
-                handled = true; // deleted in both
+                if (!inCurrent && inGiven) {
+                    stageBlobFromGiven(givBlob);
+                    handled = true;
+                } else if (inCurrent && !inGiven) {
+                    handled = true; // only current has it
+                } else if (inCurrent && inGiven && curBlob == givBlob) {
+                    handled = true; // identical add
+                }
             }
-        } else {
-            if (!inCurrent && inGiven) {
-                stageBlobFromGiven(givBlob);
-                handled = true;
-            } else if (inCurrent && !inGiven) {
-                handled = true; // only current has it
-            } else if (inCurrent && inGiven && curBlob == givBlob) {
-                handled = true; // identical add
+
+            if (handled) {
+                continue;
             }
-        }
 
-        if (handled) {
-            continue;
+            // Divergent edits: build conflict blob with both contents.  It is
+            // written even outside the sparse-checkout set, to be resolved
+            hasConflicts = true;
+            std::string curContent = inCurrent ? store.readBlob(curBlob.hex()) : "";
+            std::string givContent = inGiven ? store.readBlob(givBlob.hex()) : "";
+            std::string conflict = "<<<<<<< HEAD\r\n" + curContent + "=======\r\n" + givContent + ">>>>>>>\r\n";
+            std::string blobId = ensureBlob(conflict);
+            Utils::writeContents(name, conflict);
+            Utils::writeContents(".gitlite/staging/" + name, blobId);
         }
-
-        // Divergent edits: build conflict blob with both contents
-        hasConflicts = true;
-        std::string curContent = inCurrent ? Utils::readContentsAsString(".gitlite/objects/" + curBlob) : "";
-        std::string givContent = inGiven ? Utils::readContentsAsString(".gitlite/objects/" + givBlob) : "";
-        std::string conflict = "<<<<<<< HEAD\r\n" + curContent + "=======\r\n" + givContent + ">>>>>>>\r\n";
-        std::string blobId = ensureBlob(conflict);
-        Utils::writeContents(name, conflict);
-        Utils::writeContents(".gitlite/staging/" + name, blobId);
     }
 
     if (hasConflicts) {
-        std::cout << "Encountered a merge conflict." << std::endl;
+        out << "Encountered a merge conflict." << std::endl;
     }
 
     auto stagedFiles = Utils::plainFilenamesIn(".gitlite/staging");
     if (stagedFiles.empty()) {
-        Utils::exitWithMessage("No changes added to the commit.");
-    }
-
-    auto mergedFiles = currentCommitFiles;
-    for (const auto &file : stagedFiles) {
-        std::string marker = Utils::readContentsAsString(".gitlite/staging/" + file);
-        if (marker == "DELETE") {
-            mergedFiles.erase(file);
-        } else {
-            mergedFiles[file] = marker;
-        }
+        throw GitliteException("No changes added to the commit.");
     }
 
     auto now = std::time(nullptr);
@@ -1006,15 +1386,18 @@ void SomeObj::merge(const std::string &branchName) {
     std::string commitContent = "parent " + currentCommitId + " " + givenCommitId + "\n";
     commitContent += "timestamp " + timestamp + "\n";
     commitContent += "message Merged " + branchName + " into " + currentBranch + ".\n";
-    commitContent += "files ";
-    for (const auto &p : mergedFiles) {
-        commitContent += p.first + ":" + p.second + ";";
-    }
-    commitContent += "\n";
+    commitContent += "files " + applyStaging(currentCommitFiles) + "\n";
 
     std::string newCommitId = Utils::sha1(commitContent);
-    Utils::writeContents(".gitlite/objects/" + newCommitId, commitContent);
-    Utils::writeContents(".gitlite/refs/heads/" + currentBranch, newCommitId);
+    ObjectStore().write(newCommitId, commitContent);
+    {
+        // If the branch moved meanwhile, the merge result stays staged
+        Trace::Region region("ref_update");
+        if (!refs.compareAndSwap(RefStore::branchRef(currentBranch), currentCommitId, newCommitId)) {
+            throw GitliteException("Branch " + currentBranch + " is being updated by another process; try again.");
+        }
+    }
+    ChangedPaths::append(".gitlite/objects", newCommitId, commitContent, currentCommitFiles);
 
     if (Utils::isDirectory(".gitlite/staging")) {
         std::string cmd = "rm -rf .gitlite/staging";
@@ -1023,56 +1406,47 @@ void SomeObj::merge(const std::string &branchName) {
 }
 
 std::string SomeObj::findSplitPoint(const std::string &commitId1, const std::string &commitId2) {
-    auto parseParents = [](const std::string &commitId) {
-        std::vector<std::string> parents;
-        std::string path = ".gitlite/objects/" + commitId;
-        if (!Utils::exists(path)) return parents;
-        std::string content = Utils::readContentsAsString(path);
-        size_t pos = content.find("parent ");
-        if (pos == std::string::npos) return parents;
-        size_t end = content.find('\n', pos);
-        std::string parentLine = content.substr(pos + 7, end - pos - 7);
-        std::istringstream iss(parentLine);
-        std::string pid;
-        while (iss >> pid) parents.push_back(pid);
-        return parents;
-    };
-
-    std::unordered_map<std::string, int> dist1;
-    std::queue<std::string> q;
-    q.push(commitId1);
-    dist1[commitId1] = 0;
+    Trace::Region region("find_split_point");
+    ObjectId start1 = ObjectId::fromHex(commitId1);
+    ObjectId start2 = ObjectId::fromHex(commitId2);
+
+    ObjectIdMap<int> dist1;
+    std::queue<ObjectId> q;
+    q.push(start1);
+    dist1.insert(start1, 0);
     while (!q.empty()) {
-        std::string cur = q.front();
+        ObjectId cur = q.front();
         q.pop();
-        for (const auto &p : parseParents(cur)) {
-            if (!dist1.count(p)) {
-                dist1[p] = dist1[cur] + 1;
+        int next = *dist1.find(cur) + 1;
+        for (const auto &p : getParents(cur)) {
+            if (dist1.insert(p, next).second) {
                 q.push(p);
             }
         }
     }
 
-    std::string best;
+    ObjectId best;
+    bool found = false;
     int bestDist = INT_MAX;
-    std::queue<std::pair<std::string, int>> q2;
-    q2.push({commitId2, 0});
-    std::set<std::string> visited;
+    std::queue<std::pair<ObjectId, int>> q2;
+    q2.push({start2, 0});
+    ObjectIdSet visited;
     while (!q2.empty()) {
         auto [cur, d] = q2.front();
         q2.pop();
-        if (visited.count(cur)) continue;
-        visited.insert(cur);
-        if (dist1.count(cur) && dist1[cur] + d < bestDist) {
+        if (!visited.insert(cur)) continue;
+        const int *dist = dist1.find(cur);
+        if (dist && *dist + d < bestDist) {
             best = cur;
-            bestDist = dist1[cur] + d;
+            found = true;
+            bestDist = *dist + d;
         }
-        for (const auto &p : parseParents(cur)) {
+        for (const auto &p : getParents(cur)) {
             q2.push({p, d + 1});
         }
     }
 
-    return best.empty() ? commitId1 : best;
+    return found ? best.hex() : commitId1;
 }
 
 /**
@@ -1085,7 +1459,7 @@ void SomeObj::addRemote(const std::string &remoteName, const std::string &remote
 
     std::string remoteFile = remotesDir + "/" + remoteName;
     if (Utils::exists(remoteFile)) {
-        Utils::exitWithMessage("A remote with that name already exists.");
+        throw GitliteException("A remote with that name already exists.");
     }
 
     Utils::writeContents(remoteFile, remoteDir);
@@ -1098,7 +1472,7 @@ void SomeObj::addRemote(const std::string &remoteName, const std::string &remote
 void SomeObj::rmRemote(const std::string &remoteName) {
     std::string remoteFile = ".gitlite/remotes/" + remoteName;
     if (!Utils::exists(remoteFile)) {
-        Utils::exitWithMessage("A remote with that name does not exist.");
+        throw GitliteException("A remote with that name does not exist.");
     }
 
     Utils::restrictedDelete(remoteFile);
@@ -1115,7 +1489,7 @@ void SomeObj::rmRemote(const std::string &remoteName) {
 void SomeObj::push(const std::string &remoteName, const std::string &remoteBranchName) {
     std::string remoteFile = ".gitlite/remotes/" + remoteName;
     if (!Utils::exists(remoteFile)) {
-        Utils::exitWithMessage("A remote with that name does not exist.");
+        throw GitliteException("A remote with that name does not exist.");
     }
 
     std::string remotePath = Utils::readContentsAsString(remoteFile);
@@ -1124,116 +1498,91 @@ void SomeObj::push(const std::string &remoteName, const std::string &remoteBranc
     }
 
     if (!Utils::isDirectory(remotePath)) {
-        Utils::exitWithMessage("Remote directory not found.");
+        throw GitliteException("Remote directory not found.");
     }
 
     // Get current branch head
-    std::string headContent = Utils::readContentsAsString(".gitlite/HEAD");
-    std::string currentBranch = headContent.substr(16);
-    std::string currentCommitId = Utils::readContentsAsString(".gitlite/refs/heads/" + currentBranch);
+    RefStore refs;
+    std::string currentCommitId = refs.branchHead(refs.currentBranch());
+
+    ObjectStore localStore;
+    std::string remoteObjectsDir = remotePath + "/objects";
+    ObjectStore remoteStore(remoteObjectsDir);
 
     // Check if remote branch exists
-    std::string remoteBranchFile = remotePath + "/refs/heads/" + remoteBranchName;
-    
-    if (Utils::exists(remoteBranchFile)) {
-        std::string remoteHeadCommitId = Utils::readContentsAsString(remoteBranchFile);
-        
+    RefStore remoteRefs(remotePath);
+    std::string remoteBranchRef = RefStore::branchRef(remoteBranchName);
+    std::string remoteHeadCommitId = remoteRefs.read(remoteBranchRef);
+
+    if (!remoteHeadCommitId.empty()) {
         // Fast-forward check: remote head must be an ancestor of local head
         bool isAncestor = false;
-        std::queue<std::string> q;
-        q.push(currentCommitId);
-        std::set<std::string> visited;
+        ObjectId remoteHead = ObjectId::fromHex(remoteHeadCommitId);
+        std::queue<ObjectId> q;
+        q.push(ObjectId::fromHex(currentCommitId));
+        ObjectIdSet visited;
         
         while(!q.empty()) {
-            std::string cid = q.front();
+            ObjectId cid = q.front();
             q.pop();
-            if (cid == remoteHeadCommitId) {
+            if (cid == remoteHead) {
                 isAncestor = true;
                 break;
             }
-            if (visited.count(cid)) continue;
-            visited.insert(cid);
+            if (!visited.insert(cid)) continue;
             
             // Get parents
-            std::string path = ".gitlite/objects/" + cid;
-            if (Utils::exists(path)) {
-                std::string content = Utils::readContentsAsString(path);
-                size_t pos = content.find("parent ");
-                if (pos != std::string::npos) {
-                    size_t end = content.find('\n', pos);
-                    std::string parentLine = content.substr(pos + 7, end - pos - 7);
-                    std::istringstream iss(parentLine);
-                    std::string p;
-                    while(iss >> p) q.push(p);
-                }
+            for (const auto &p : getParents(cid)) {
+                q.push(p);
             }
         }
         
         if (!isAncestor) {
-            Utils::exitWithMessage("Please pull down remote changes before pushing.");
+            throw GitliteException("Please pull down remote changes before pushing.");
         }
     }
 
-    // Copy commits and blobs reachable from local head into remote objects/
-    std::queue<std::string> q;
-    q.push(currentCommitId);
-    std::set<std::string> visited;
+    // Copy commits and blobs reachable from local head into remote objects/;
+    // chunked blobs only send the chunks the remote lacks
+    std::queue<ObjectId> q;
+    q.push(ObjectId::fromHex(currentCommitId));
+    ObjectIdSet visited;
     
-    while(!q.empty()) {
-        std::string commitId = q.front();
-        q.pop();
-        
-        if (visited.count(commitId)) continue;
-        visited.insert(commitId);
+    {
+        Trace::Region region("push.copy_objects");
+        while(!q.empty()) {
+            ObjectId id = q.front();
+            q.pop();
         
-        std::string localObjectPath = ".gitlite/objects/" + commitId;
-        std::string remoteObjectPath = remotePath + "/objects/" + commitId;
+            if (!visited.insert(id)) continue;
         
-        if (Utils::exists(remoteObjectPath)) {
-            continue; 
-        }
+            std::string commitId = id.hex();
+            if (remoteStore.contains(commitId) || !localStore.contains(commitId)) {
+                continue; 
+            }
         
-        if (Utils::exists(localObjectPath)) {
-            std::string content = Utils::readContentsAsString(localObjectPath);
-            Utils::writeContents(remoteObjectPath, content);
-            
-            // Parse parents and enqueue for BFS copy
-            size_t pos = content.find("parent ");
-            if (pos != std::string::npos) {
-                size_t end = content.find('\n', pos);
-                std::string parentLine = content.substr(pos + 7, end - pos - 7);
-                std::istringstream iss(parentLine);
-                std::string p;
-                while(iss >> p) q.push(p);
+            std::string content = localStore.read(commitId);
+            std::vector<ObjectId> parents, blobIds;
+            parseCommitLinks(content, parents, blobIds);
+            localStore.copyTo(commitId, remoteStore);
+            ChangedPaths::append(remoteObjectsDir, commitId, content, localStore);
+
+            // Copy blobs referenced by this commit, then continue with its parents
+            for (const auto &blobId : blobIds) {
+                localStore.copyBlobTo(blobId.hex(), remoteStore);
             }
-            
-            // Copy blobs referenced by this commit
-            size_t filesPos = content.find("files ");
-            if (filesPos != std::string::npos) {
-                std::string filesSection = content.substr(filesPos + 6);
-                size_t start = 0;
-                while (start < filesSection.length()) {
-                    size_t colonPos = filesSection.find(':', start);
-                    if (colonPos == std::string::npos) break;
-                    size_t semicolonPos = filesSection.find(';', colonPos);
-                    if (semicolonPos == std::string::npos) break;
-                    
-                    std::string blobId = filesSection.substr(colonPos + 1, semicolonPos - colonPos - 1);
-                    std::string localBlobPath = ".gitlite/objects/" + blobId;
-                    std::string remoteBlobPath = remotePath + "/objects/" + blobId;
-                    
-                    if (Utils::exists(localBlobPath) && !Utils::exists(remoteBlobPath)) {
-                        std::string blobContent = Utils::readContentsAsString(localBlobPath);
-                        Utils::writeContents(remoteBlobPath, blobContent);
-                    }
-                    start = semicolonPos + 1;
-                }
+            for (const auto &p : parents) {
+                q.push(p);
             }
         }
     }
     
-    // Update remote branch head to local head commit
-    Utils::writeContents(remoteBranchFile, currentCommitId);
+    // Update remote branch head to local head commit, unless someone else
+    // pushed since it was checked
+    Trace::Region refRegion("ref_update");
+    if (!remoteRefs.compareAndSwap(remoteBranchRef, remoteHeadCommitId, currentCommitId)) {
+        throw GitliteException("Please pull down remote changes before pushing.");
+    }
 }
 
 /**
@@ -1246,7 +1595,7 @@ void SomeObj::push(const std::string &remoteName, const std::string &remoteBranc
 void SomeObj::fetch(const std::string &remoteName, const std::string &remoteBranchName) {
     std::string remoteFile = ".gitlite/remotes/" + remoteName;
     if (!Utils::exists(remoteFile)) {
-        Utils::exitWithMessage("A remote with that name does not exist.");
+        throw GitliteException("A remote with that name does not exist.");
     }
 
     std::string remotePath = Utils::readContentsAsString(remoteFile);
@@ -1255,82 +1604,59 @@ void SomeObj::fetch(const std::string &remoteName, const std::string &remoteBran
     }
 
     if (!Utils::isDirectory(remotePath)) {
-        Utils::exitWithMessage("Remote directory not found.");
+        throw GitliteException("Remote directory not found.");
     }
 
-    std::string remoteBranchFile = remotePath + "/refs/heads/" + remoteBranchName;
-    if (!Utils::exists(remoteBranchFile)) {
-        Utils::exitWithMessage("That remote does not have that branch.");
+    std::string remoteHeadCommitId = RefStore(remotePath).branchHead(remoteBranchName);
+    if (remoteHeadCommitId.empty()) {
+        throw GitliteException("That remote does not have that branch.");
     }
-
-    std::string remoteHeadCommitId = Utils::readContentsAsString(remoteBranchFile);
     
     // Copy objects from remote
-    // BFS over commit graph starting from remote head; copy commits + blobs locally
-    std::queue<std::string> q;
-    q.push(remoteHeadCommitId);
-    std::set<std::string> visited;
+    // BFS over commit graph starting from remote head; copy commits + blobs locally,
+    // fetching only the chunks of chunked blobs that are not here yet
+    ObjectStore localStore;
+    ObjectStore remoteStore(remotePath + "/objects");
+    std::queue<ObjectId> q;
+    q.push(ObjectId::fromHex(remoteHeadCommitId));
+    ObjectIdSet visited;
 
-    while(!q.empty()) {
-        std::string commitId = q.front();
-        q.pop();
+    {
+        Trace::Region region("fetch.copy_objects");
+        while(!q.empty()) {
+            ObjectId id = q.front();
+            q.pop();
         
-        if (visited.count(commitId)) continue;
-        visited.insert(commitId);
+            if (!visited.insert(id)) continue;
 
-        std::string remoteObjectPath = remotePath + "/objects/" + commitId;
-        std::string localObjectPath = ".gitlite/objects/" + commitId;
-        
-        if (!Utils::exists(remoteObjectPath)) {
-            continue; 
-        }
+            std::string commitId = id.hex();
+            if (!remoteStore.contains(commitId)) {
+                continue; 
+            }
 
-        std::string content = Utils::readContentsAsString(remoteObjectPath);
-        if (!Utils::exists(localObjectPath)) {
-            Utils::writeContents(localObjectPath, content);
-        }
+            std::string content = remoteStore.read(commitId);
+            std::vector<ObjectId> parents, blobIds;
+            parseCommitLinks(content, parents, blobIds);
+            if (!localStore.contains(commitId)) {
+                remoteStore.copyTo(commitId, localStore);
+                ChangedPaths::append(".gitlite/objects", commitId, content, remoteStore);
+            }
 
-        // Parse parents to continue BFS
-        size_t pos = content.find("parent ");
-        if (pos != std::string::npos) {
-            size_t end = content.find('\n', pos);
-            std::string parentLine = content.substr(pos + 7, end - pos - 7);
-            std::istringstream iss(parentLine);
-            std::string p;
-            while(iss >> p) {
+            // Parse parents to continue BFS
+            for (const auto &p : parents) {
                 q.push(p);
             }
-        }
 
-        // Copy blobs referenced by this commit
-        size_t filesPos = content.find("files ");
-        if (filesPos != std::string::npos) {
-            std::string filesSection = content.substr(filesPos + 6);
-            size_t start = 0;
-            while (start < filesSection.length()) {
-                size_t colonPos = filesSection.find(':', start);
-                if (colonPos == std::string::npos) break;
-                size_t semicolonPos = filesSection.find(';', colonPos);
-                if (semicolonPos == std::string::npos) break;
-                
-                std::string blobId = filesSection.substr(colonPos + 1, semicolonPos - colonPos - 1);
-                
-                std::string remoteBlobPath = remotePath + "/objects/" + blobId;
-                std::string localBlobPath = ".gitlite/objects/" + blobId;
-                
-                if (Utils::exists(remoteBlobPath) && !Utils::exists(localBlobPath)) {
-                    std::string blobContent = Utils::readContentsAsString(remoteBlobPath);
-                    Utils::writeContents(localBlobPath, blobContent);
-                }
-                
-                start = semicolonPos + 1;
+            // Copy blobs referenced by this commit
+            for (const auto &blobId : blobIds) {
+                remoteStore.copyBlobTo(blobId.hex(), localStore);
             }
         }
     }
 
     // Update local tracking ref to fetched head
-    std::string refPath = ".gitlite/refs/heads/" + remoteName + "/" + remoteBranchName;
-    Utils::writeContents(refPath, remoteHeadCommitId);
+    Trace::Region refRegion("ref_update");
+    RefStore().write(RefStore::branchRef(remoteName + "/" + remoteBranchName), remoteHeadCommitId);
 }
 
 /**
@@ -1344,53 +1670,689 @@ void SomeObj::pull(const std::string &remoteName, const std::string &remoteBranc
     merge(remoteName + "/" + remoteBranchName);
 }
 
+/**
+ * Creates a copy of the repository in SOURCEDIR in DESTINATIONDIR, which must not exist or be
+ * an empty directory.
+ * Objects are immutable, so they are hard-linked rather than copied (see ObjectStore::linkTo);
+ * no object is parsed and no history is walked. If the source borrows objects through
+ * objects/info/alternates, the clone borrows from the same directories. Every local branch of
+ * the source becomes the remote-tracking branch origin/<branch>, the remote "origin" is set to
+ * the source, and the source's current branch is created locally and checked out.
+ */
+void SomeObj::clone(const std::string &sourceDir, const std::string &destinationDir) {
+    std::string sourceGitlite = sourceDir + "/.gitlite";
+    if (!Utils::isDirectory(sourceGitlite)) {
+        throw GitliteException("Source repository not found.");
+    }
+    if (Utils::exists(destinationDir) && !Utils::isEmptyDirectory(destinationDir)) {
+        throw GitliteException(destinationDir + " already exists.");
+    }
+    char sourcePath[PATH_MAX];
+    if (realpath(sourceGitlite.c_str(), sourcePath) == nullptr) {
+        throw GitliteException("Source repository not found.");
+    }
+
+    std::string gitliteDir = destinationDir + "/.gitlite";
+    Utils::createDirectories(gitliteDir + "/objects");
+    Utils::createDirectories(gitliteDir + "/refs/heads");
+    Utils::createDirectories(gitliteDir + "/refs/remotes");
+
+    // The clone borrows from wherever the source does; relative entries are
+    // relative to the source's objects directory, so make them absolute
+    std::string alternates = "/objects/info/alternates";
+    if (Utils::isFile(sourceGitlite + alternates)) {
+        std::istringstream lines(Utils::readContentsAsString(sourceGitlite + alternates));
+        std::string resolved;
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (!line.empty() && line[0] != '#' && line[0] != '/') {
+                line = std::string(sourcePath) + "/objects/" + line;
+                char dirPath[PATH_MAX];
+                if (realpath(line.c_str(), dirPath) != nullptr) {
+                    line = dirPath;
+                }
+            }
+            resolved += line + "\n";
+        }
+        Utils::createDirectories(gitliteDir + "/objects/info");
+        Utils::writeContents(gitliteDir + alternates, resolved);
+    }
 
-// Helper methods
-std::map<std::string, std::string> SomeObj::getFilesInCommit(const std::string &commitId) {
-    std::map<std::string, std::string> files;
+    // Objects first, so that every ref written below names objects that are here
+    ObjectStore sourceStore(sourceGitlite + "/objects");
+    ObjectStore store(gitliteDir + "/objects");
+    {
+        Trace::Region region("clone.link_objects");
+        for (const auto &objectId : Utils::plainFilenamesIn(sourceGitlite + "/objects")) {
+            if (ObjectStore::isTemporary(objectId)) {
+                continue;
+            }
+            sourceStore.linkTo(objectId, store);
+        }
+        // Copied, not linked: each repository appends to its own
+        std::string changedPaths = "/objects/info/changed-paths";
+        if (Utils::isFile(sourceGitlite + changedPaths)) {
+            Utils::createDirectories(gitliteDir + "/objects/info");
+            Utils::writeContents(gitliteDir + changedPaths, Utils::readContentsAsString(sourceGitlite + changedPaths));
+        }
+    }
 
-    std::string commitPath = ".gitlite/objects/" + commitId;
-    if (!Utils::exists(commitPath)) {
-        return files;
+    RefStore sourceRefs(sourceGitlite);
+    RefStore refs(gitliteDir);
+    for (const auto &branch : sourceRefs.localBranches()) {
+        std::string commitId = sourceRefs.branchHead(branch);
+        if (!commitId.empty()) { // deleted since it was listed
+            refs.write(RefStore::branchRef("origin/" + branch), commitId);
+        }
     }
+    std::string branch = sourceRefs.currentBranch();
+    std::string headCommitId = refs.branchHead("origin/" + branch);
+    refs.write(RefStore::branchRef(branch), headCommitId);
+    refs.write("HEAD", "ref: " + RefStore::branchRef(branch));
+    Utils::writeContents(gitliteDir + "/remotes/origin", sourcePath);
 
-    std::string commitContent = Utils::readContentsAsString(commitPath);
-    size_t filesPos = commitContent.find("files ");
-    if (filesPos == std::string::npos) {
-        return files;
+    Trace::Region region("clone.write_worktree");
+    for (const auto &entry : Manifest::fromCommit(store.read(headCommitId))) {
+        store.checkoutBlob(entry.blobId.hex(), destinationDir + "/" + std::string(entry.name));
     }
+}
 
-    std::string filesSection = commitContent.substr(filesPos + 6);
-    size_t newlinePos = filesSection.find('\n');
-    if (newlinePos != std::string::npos) {
-        filesSection = filesSection.substr(0, newlinePos);
+/**
+ * Moves every branch and remote-tracking ref into .gitlite/packed-refs, so that
+ * repositories with many branches keep them in one sorted file instead of one
+ * file (and, for remote-tracking refs, one directory per remote) each.  Refs
+ * updated afterwards are written loose again and override their packed entries.
+ */
+void SomeObj::packRefs() {
+    RefStore().pack();
+}
+
+/**
+ * Creates a linked worktree in directory DIR with branch BRANCHNAME checked out. The new worktree
+ * has its own HEAD and staging area and shares objects and refs with this repository. DIR must
+ * not exist yet, and no worktree may have the branch checked out already.
+ */
+void SomeObj::addWorktree(const std::string &dir, const std::string &branchName) {
+    std::string commitId = RefStore().branchHead(branchName);
+    if (commitId.empty()) {
+        throw GitliteException("No such branch exists.");
+    }
+    if (Utils::exists(dir)) {
+        throw GitliteException(dir + " already exists.");
     }
 
-    // Parse files section
-    size_t start = 0;
-    while (start < filesSection.length()) {
-        size_t colonPos = filesSection.find(':', start);
-        if (colonPos == std::string::npos)
-            break;
+    LockFile worktreesLock(Worktree::lockPath());
+    for (const auto &tree : Worktree::list()) {
+        if (tree.branch == branchName) {
+            throw GitliteException("Branch " + branchName + " is already checked out at " + tree.path + ".");
+        }
+    }
+    if (!Utils::createDirectories(dir)) {
+        throw GitliteException("Cannot create worktree in " + dir + ".");
+    }
+    Worktree::create(dir, branchName);
 
-        size_t semicolonPos = filesSection.find(';', colonPos);
-        if (semicolonPos == std::string::npos)
-            break;
+    Trace::Region region("worktree.write_worktree");
+    ObjectStore store;
+    for (const auto &entry : getFilesInCommit(commitId)) {
+        store.checkoutBlob(entry.blobId.hex(), dir + "/" + std::string(entry.name));
+    }
+}
 
-        std::string filename = filesSection.substr(start, colonPos - start);
-        std::string blobId = filesSection.substr(colonPos + 1, semicolonPos - colonPos - 1);
+/** Prints every worktree, the main one first, as "<path> [<branch>]". */
+void SomeObj::listWorktrees() {
+    for (const auto &tree : Worktree::list()) {
+        out << tree.path << " [" << tree.branch << "]" << std::endl;
+    }
+}
 
-        // Only add file if it's not marked as DELETE
-        if (blobId != "DELETE") {
-            files[filename] = blobId;
+/**
+ * Replaces the sparse-checkout set with PATTERNS (an empty list disables sparse checkout).
+ * Only paths whose membership changes are touched: files that leave the set are deleted from
+ * the working tree and files that join it are written, with their staged version if they have
+ * one and their version in the current commit otherwise. Everything is checked before anything
+ * is changed: a leaving file with changes that are not staged, or an untracked file where a
+ * joining file would go, aborts the command.
+ */
+void SomeObj::setSparseCheckout(const std::vector<std::string> &patterns) {
+    StagingLock lock(*this);
+    SparseCheckout before = SparseCheckout::load();
+    SparseCheckout after = SparseCheckout::fromPatterns(patterns);
+
+    // The version each tracked or staged path should have in the working
+    // tree: its staged blob, else its blob in the current commit
+    RefStore refs;
+    Manifest trackedFiles = getFilesInCommit(refs.branchHead(refs.currentBranch()));
+    std::map<std::string, std::string> expected;
+    for (const auto &entry : trackedFiles) {
+        expected.emplace(std::string(entry.name), entry.blobId.hex());
+    }
+    for (const auto &file : Utils::plainFilenamesIn(".gitlite/staging")) {
+        std::string content = Utils::readContentsAsString(".gitlite/staging/" + file);
+        if (content == "DELETE") {
+            expected.erase(file);
+        } else {
+            expected[file] = content;
+        }
+    }
+
+    std::vector<const std::pair<const std::string, std::string> *> leaving, joining;
+    for (const auto &file : expected) {
+        bool wasIncluded = before.includes(file.first);
+        if (wasIncluded != after.includes(file.first)) {
+            (wasIncluded ? leaving : joining).push_back(&file);
+        }
+    }
+    for (const auto *file : leaving) {
+        if (Utils::isFile(file->first) &&
+            Utils::sha1(Utils::readContentsAsString(file->first)) != file->second) {
+            throw GitliteException("File " + file->first +
+                                   " has changes not staged for commit; add or restore it first.");
+        }
+    }
+    for (const auto *file : joining) {
+        if (Utils::isFile(file->first) &&
+            Utils::sha1(Utils::readContentsAsString(file->first)) != file->second) {
+            throw GitliteException("There is an untracked file in the way; delete it, or add and commit it first.");
         }
-        start = semicolonPos + 1;
     }
 
+    Trace::Region region("sparse_checkout.update_worktree");
+    ObjectStore store;
+    for (const auto *file : leaving) {
+        Utils::restrictedDelete(file->first);
+    }
+    for (const auto *file : joining) {
+        if (!Utils::isFile(file->first)) {
+            store.checkoutBlob(file->second, file->first);
+        }
+    }
+    SparseCheckout::save(patterns);
+}
+
+/** Prints the sparse-checkout patterns, one per line; nothing if sparse checkout is off. */
+void SomeObj::listSparseCheckout() {
+    SparseCheckout sparse = SparseCheckout::load();
+    for (const auto &pattern : sparse.patterns()) {
+        out << pattern << std::endl;
+    }
+}
+
+/**
+ * Deletes objects that can no longer be reached.
+ * Mark: starting from every ref under refs/heads (remote-tracking refs included) and every blob
+ * in the staging area, commits are walked in parallel on a thread pool, marking each commit, the
+ * blobs in its manifest and the chunks of chunked blobs. Sweep: every unmarked object whose
+ * modification time is older than GRACEPERIODSECONDS is removed; a chunk list that is kept keeps
+ * its chunks. Objects written or freshened after gc started are never removed, and the staging
+ * area is read again just before deleting, so a concurrent add keeps its blob.
+ */
+void SomeObj::gc(long long gracePeriodSeconds) {
+    struct timespec startTime;
+    clock_gettime(CLOCK_REALTIME, &startTime);
+
+    // === Mark ===
+    ObjectIdSet reachable;
+    std::mutex reachableLock;
+    ThreadPool pool;
+    ObjectStore store;
+
+    std::function<void(const ObjectId &)> markCommit = [&](const ObjectId &commitId) {
+        {
+            std::lock_guard<std::mutex> lock(reachableLock);
+            if (!reachable.insert(commitId)) {
+                return;
+            }
+        }
+
+        std::vector<ObjectId> parents, blobIds;
+        if (!readCommitLinks(commitId, parents, blobIds)) {
+            return;
+        }
+        std::vector<ObjectId> newBlobs;
+        {
+            std::lock_guard<std::mutex> lock(reachableLock);
+            for (const auto &blobId : blobIds) {
+                if (reachable.insert(blobId)) {
+                    newBlobs.push_back(blobId);
+                }
+            }
+        }
+        std::vector<ObjectId> chunkIds;
+        for (const auto &blobId : newBlobs) {
+            for (const auto &chunkId : store.chunksOf(blobId.hex())) {
+                chunkIds.push_back(ObjectId::fromHex(chunkId));
+            }
+        }
+        if (!chunkIds.empty()) {
+            std::lock_guard<std::mutex> lock(reachableLock);
+            for (const auto &chunkId : chunkIds) {
+                reachable.insert(chunkId);
+            }
+        }
+        for (const auto &parent : parents) {
+            pool.submit([&markCommit, parent] { markCommit(parent); });
+        }
+    };
+
+    for (const auto &commitId : getRefCommits()) {
+        ObjectId id;
+        if (ObjectId::parse(commitId, id)) {
+            pool.submit([&markCommit, id] { markCommit(id); });
+        }
+    }
+    {
+        Trace::Region region("gc.mark");
+        pool.wait();
+    }
+
+    // Object file names that are not IDs are never reachable
+    auto isReachable = [&reachable](const std::string &objectId) {
+        ObjectId id;
+        return ObjectId::parse(objectId, id) && reachable.contains(id);
+    };
+
+    // Marks a blob and its chunks once the pool is idle
+    auto markBlob = [&reachable, &store](const std::string &blobId) {
+        ObjectId id;
+        if (ObjectId::parse(blobId, id) && reachable.insert(id)) {
+            for (const auto &chunkId : store.chunksOf(blobId)) {
+                reachable.insert(ObjectId::fromHex(chunkId));
+            }
+        }
+    };
+    for (const auto &blobId : getStagedBlobs()) {
+        markBlob(blobId);
+    }
+
+    // === Sweep ===
+    std::vector<std::string> candidates;
+    for (const auto &objectId : Utils::plainFilenamesIn(".gitlite/objects")) {
+        if (!isReachable(objectId)) {
+            candidates.push_back(objectId);
+        }
+    }
+
+    // Pick up anything staged while we were marking
+    for (const auto &blobId : getStagedBlobs()) {
+        markBlob(blobId);
+    }
+
+    long long removedObjects = 0;
+    long long removedBytes = 0;
+    {
+        Trace::Region region("gc.sweep");
+        auto isFresh = [&startTime](const struct stat &info) {
+            return info.st_mtim.tv_sec > startTime.tv_sec ||
+                   (info.st_mtim.tv_sec == startTime.tv_sec && info.st_mtim.tv_nsec >= startTime.tv_nsec);
+        };
+        std::vector<std::string> doomed;
+        for (const auto &objectId : candidates) {
+            if (isReachable(objectId)) {
+                continue;
+            }
+
+            std::string objectPath = ".gitlite/objects/" + objectId;
+            struct stat info;
+            if (stat(objectPath.c_str(), &info) != 0) {
+                continue;
+            }
+
+            // A temporary file may belong to a write still in progress
+            if (ObjectStore::isTemporary(objectId)) {
+                if (startTime.tv_sec - info.st_mtim.tv_sec >= std::max(gracePeriodSeconds, TEMPORARY_GRACE_SECONDS)) {
+                    doomed.push_back(objectId);
+                }
+                continue;
+            }
+
+            // Written or freshened since gc started (someone is using it), or
+            // within the grace period: keep it, and its chunks with it
+            if (isFresh(info) || startTime.tv_sec - info.st_mtim.tv_sec < gracePeriodSeconds) {
+                markBlob(objectId);
+                continue;
+            }
+            doomed.push_back(objectId);
+        }
+
+        // Recheck right before unlinking: an object written again since the
+        // scan above got a fresh mtime and must survive
+        for (const auto &objectId : doomed) {
+            std::string objectPath = ".gitlite/objects/" + objectId;
+            struct stat info;
+            if (isReachable(objectId) || stat(objectPath.c_str(), &info) != 0 || isFresh(info)) {
+                continue;
+            }
+            if (remove(objectPath.c_str()) == 0) {
+                ++removedObjects;
+                removedBytes += info.st_size;
+            }
+        }
+    }
+
+    clearCaches();
+    out << "Removed " << removedObjects << " unreachable objects (" << removedBytes << " bytes)." << std::endl;
+}
+
+
+/**
+ * Verifies the integrity of the object store and prints one line per problem:
+ *   corrupt <id>           object contents (joined chunks, for a chunked blob) do not hash to its name
+ *   missing commit <id>    a ref or commit names a parent that is not stored
+ *   missing blob <id>      a commit manifest or the staging area names a blob that is not stored
+ *   missing chunk <id>     a chunked blob lists a chunk that is not stored
+ *   dangling commit <id>   a stored commit that nothing refers to
+ *   dangling blob <id>     a stored blob that nothing refers to
+ * Objects are read and rehashed in parallel; linking is then checked in memory.
+ * Returns true if nothing is corrupt or missing (dangling objects are not errors).
+ */
+bool SomeObj::fsck() {
+    struct ObjectInfo {
+        bool isCommit = false;
+        bool corrupt = false;
+        std::vector<ObjectId> parents;
+        std::vector<ObjectId> blobIds;
+        std::vector<std::string> chunkIds;
+    };
+
+    // Other names (temporary files of writes in progress) are not objects
+    std::vector<std::string> objectIds;
+    for (auto &name : Utils::plainFilenamesIn(".gitlite/objects")) {
+        ObjectId id;
+        if (ObjectId::parse(name, id)) {
+            objectIds.push_back(std::move(name));
+        }
+    }
+    std::vector<ObjectInfo> objects(objectIds.size());
+    ObjectStore store;
+
+    // === Rehash every object, one batch per task ===
+    ThreadPool pool;
+    size_t batchSize = std::max<size_t>(1, objectIds.size() / (pool.size() * 8) + 1);
+    for (size_t begin = 0; begin < objectIds.size(); begin += batchSize) {
+        size_t end = std::min(objectIds.size(), begin + batchSize);
+        pool.submit([&objectIds, &objects, &store, begin, end] {
+            SHA1::SHA hasher; // the shared SHA1::sha instance is not thread-safe
+            for (size_t i = begin; i < end; ++i) {
+                std::string content;
+                if (!ObjectStore::decode(Utils::readContentsAsString(".gitlite/objects/" + objectIds[i]), content)) {
+                    objects[i].corrupt = true;
+                    continue;
+                }
+                std::string digest = hasher.sha(content);
+                if (digest == objectIds[i] || !ObjectStore::isChunkList(content)) {
+                    objects[i].corrupt = digest != objectIds[i];
+                    objects[i].isCommit = parseCommitLinks(content, objects[i].parents, objects[i].blobIds);
+                    continue;
+                }
+                // A chunked blob: its name is the hash of its chunks joined
+                objects[i].chunkIds = ObjectStore::parseChunkList(content);
+                std::string joined;
+                bool complete = true;
+                for (const auto &chunkId : objects[i].chunkIds) {
+                    std::string chunk;
+                    if (!store.read(chunkId, chunk)) {
+                        complete = false; // reported as missing or corrupt
+                        break;
+                    }
+                    joined += chunk;
+                }
+                objects[i].corrupt = complete && hasher.sha(joined) != objectIds[i];
+            }
+        });
+    }
+    {
+        Trace::Region region("fsck.rehash");
+        pool.wait();
+    }
+
+    // === Check links ===
+    ObjectIdMap<size_t> index;
+    index.reserve(objectIds.size());
+    for (size_t i = 0; i < objectIds.size(); ++i) {
+        index.insert(ObjectId::fromHex(objectIds[i]), i);
+    }
+
+    std::set<std::string> problems;
+    ObjectIdSet referenced;
+    // Objects borrowed from alternates are not checked, only looked for
+    auto expect = [&](const ObjectId &id, bool wantCommit) {
+        referenced.insert(id);
+        const size_t *found = index.find(id);
+        if (found ? objects[*found].isCommit != wantCommit : !store.contains(id.hex())) {
+            problems.insert(std::string(wantCommit ? "missing commit " : "missing blob ") + id.hex());
+        }
+    };
+    // Refs and staged entries are text and may not hold an ID at all
+    auto expectNamed = [&](const std::string &name, bool wantCommit) {
+        ObjectId id;
+        if (ObjectId::parse(name, id)) {
+            expect(id, wantCommit);
+        } else {
+            problems.insert(std::string(wantCommit ? "missing commit " : "missing blob ") + name);
+        }
+    };
+
+    for (const auto &commitId : getRefCommits()) {
+        expectNamed(commitId, true);
+    }
+    for (const auto &blobId : getStagedBlobs()) {
+        expectNamed(blobId, false);
+    }
+    for (size_t i = 0; i < objectIds.size(); ++i) {
+        if (objects[i].corrupt) {
+            problems.insert("corrupt " + objectIds[i]);
+        }
+        for (const auto &parent : objects[i].parents) {
+            expect(parent, true);
+        }
+        for (const auto &blobId : objects[i].blobIds) {
+            expect(blobId, false);
+        }
+        for (const auto &chunkId : objects[i].chunkIds) {
+            ObjectId id = ObjectId::fromHex(chunkId);
+            referenced.insert(id);
+            if (!index.contains(id) && !store.contains(chunkId)) {
+                problems.insert("missing chunk " + chunkId);
+            }
+        }
+    }
+
+    bool healthy = problems.empty();
+    std::ostringstream report;
+    for (const auto &problem : problems) {
+        report << problem << "\n";
+    }
+    for (size_t i = 0; i < objectIds.size(); ++i) {
+        if (!referenced.contains(ObjectId::fromHex(objectIds[i]))) {
+            report << (objects[i].isCommit ? "dangling commit " : "dangling blob ") << objectIds[i] << "\n";
+        }
+    }
+    out << report.str() << std::flush;
+    return healthy;
+}
+
+
+// Helper methods
+
+/**
+ * Returns the manifest of commit COMMITID, or an empty one if there is no such object. Objects
+ * are immutable, so parsed manifests are cached for the lifetime of this SomeObj (see
+ * clearCaches()); returning one only copies a shared pointer.
+ */
+Manifest SomeObj::getFilesInCommit(const std::string &commitId) {
+    auto cached = manifestCache.find(commitId);
+    if (cached != manifestCache.end()) {
+        Trace::count(Trace::CACHE_HITS);
+        return cached->second;
+    }
+    Trace::count(Trace::CACHE_MISSES);
+    Trace::Region region("parse_manifest");
+
+    ObjectStore store;
+    if (!store.contains(commitId)) {
+        return Manifest();
+    }
+    Manifest files = Manifest::fromCommit(store.read(commitId));
+
+    // Bound the cache by total entries; start over when it gets too big
+    if (manifestCacheEntries + files.size() > MANIFEST_CACHE_LIMIT) {
+        manifestCache.clear();
+        manifestCacheEntries = 0;
+    }
+    manifestCacheEntries += files.size();
+    manifestCache.emplace(commitId, files);
+    return files;
+}
+
+/**
+ * Returns the "files" line body of manifest BASE with the staged changes applied: staged blobs
+ * replace or add entries, and DELETE markers (null IDs once parsed) drop them.
+ */
+std::string SomeObj::applyStaging(const Manifest &base) {
+    std::vector<std::pair<std::string, std::string>> changes;
+    if (Utils::isDirectory(".gitlite/staging")) {
+        for (const auto &file : Utils::plainFilenamesIn(".gitlite/staging")) {
+            changes.emplace_back(file, Utils::readContentsAsString(".gitlite/staging/" + file));
+        }
+    }
+    Manifest staged = Manifest::fromEntries(changes);
+
+    std::string files;
+    Manifest::Join join({&base, &staged});
+    while (join.next()) {
+        ObjectId blobId = join.has(1) ? join.blobId(1) : join.blobId(0);
+        if (!blobId.isNull()) { // staged DELETE
+            files.append(join.name()).append(1, ':');
+            blobId.appendHex(files);
+            files.append(1, ';');
+        }
+    }
     return files;
 }
 
+/**
+ * Returns the parent IDs of commit COMMITID (empty if there is no such commit), cached. The
+ * reference is valid until the next call.
+ */
+const std::vector<ObjectId> &SomeObj::getParents(const ObjectId &commitId) {
+    if (const auto *cached = parentCache.find(commitId)) {
+        Trace::count(Trace::CACHE_HITS);
+        return *cached;
+    }
+    Trace::count(Trace::CACHE_MISSES);
+
+    std::vector<ObjectId> parents;
+    ObjectStore store;
+    std::string hex = commitId.hex();
+    if (store.contains(hex)) {
+        parseParents(store.read(hex), parents);
+    }
+    return *parentCache.insert(commitId, std::move(parents)).first;
+}
+
+/**
+ * Lists the plain files in the working directory, through the fsmonitor daemon if it runs.
+ * Ignored files are left out: they are expendable, so checkout, reset and merge overwrite them
+ * instead of refusing to (a tracked file is never ignored, and callers skip tracked files anyway).
+ */
+std::vector<std::string> SomeObj::listWorkingFiles() {
+    WorktreeSnapshot worktree;
+    worktree.load();
+    IgnoreRules ignore = IgnoreRules::load();
+    std::vector<std::string> files;
+    for (const auto &file : worktree.files()) {
+        if (!ignore.ignored(file)) {
+            files.push_back(file);
+        }
+    }
+    return files;
+}
+
+/** Drops every cached object parse; needed after objects have been deleted. */
+void SomeObj::clearCaches() {
+    manifestCache.clear();
+    manifestCacheEntries = 0;
+    parentCache.clear();
+}
+
 bool SomeObj::isFileTrackedInCommit(const std::string &filename, const std::string &commitId) {
-    auto files = getFilesInCommit(commitId);
-    return files.find(filename) != files.end();
-}
\ No newline at end of file
+    return getFilesInCommit(commitId).contains(filename);
+}
+
+/**
+ * Reads the commit COMMITID and appends its parent IDs and the blob IDs of its manifest.
+ * Returns false if COMMITID does not name a commit object.
+ */
+bool SomeObj::readCommitLinks(const ObjectId &commitId, std::vector<ObjectId> &parents,
+                              std::vector<ObjectId> &blobIds) {
+    std::string content;
+    if (!ObjectStore().read(commitId.hex(), content)) {
+        return false;
+    }
+    return parseCommitLinks(content, parents, blobIds);
+}
+
+/**
+ * Appends the IDs on the "parent" line of commit object CONTENT to PARENTS. Returns false if
+ * CONTENT is not a commit.
+ */
+bool SomeObj::parseParents(const std::string &content, std::vector<ObjectId> &parents) {
+    if (content.compare(0, 7, "parent ") != 0) {
+        return false;
+    }
+    size_t end = std::min(content.find('\n'), content.size());
+    size_t start = 7;
+    while (start < end) {
+        size_t space = std::min(content.find(' ', start), end);
+        ObjectId id;
+        if (ObjectId::parse(std::string_view(content).substr(start, space - start), id)) {
+            parents.push_back(id);
+        }
+        start = space + 1;
+    }
+    return true;
+}
+
+/**
+ * Parses commit object CONTENT, appending its parent IDs and manifest blob IDs.
+ * Returns false if CONTENT is not a commit.
+ */
+bool SomeObj::parseCommitLinks(const std::string &content, std::vector<ObjectId> &parents,
+                               std::vector<ObjectId> &blobIds) {
+    if (!parseParents(content, parents)) {
+        return false;
+    }
+    for (const auto &entry : Manifest::fromCommit(content)) {
+        blobIds.push_back(entry.blobId);
+    }
+    return true;
+}
+
+/** Returns the commit IDs named by every branch, including remote-tracking branches. */
+std::vector<std::string> SomeObj::getRefCommits() {
+    std::vector<std::string> commitIds;
+    RefStore refs;
+    for (const auto &branch : refs.branches()) {
+        std::string commitId = refs.branchHead(branch);
+        if (!commitId.empty()) { // deleted since it was listed
+            commitIds.push_back(commitId);
+        }
+    }
+    return commitIds;
+}
+
+/** Returns the blob IDs currently staged for addition, in every worktree. */
+std::vector<std::string> SomeObj::getStagedBlobs() {
+    std::vector<std::string> blobIds;
+    for (const auto &tree : Worktree::list()) {
+        std::string staging = tree.path + "/.gitlite/staging";
+        for (const auto &file : Utils::plainFilenamesIn(staging)) {
+            std::string marker = Utils::readContentsAsString(staging + "/" + file);
+            if (marker != "DELETE") {
+                blobIds.push_back(marker);
+            }
+        }
+    }
+    return blobIds;
+}
@@ -0,0 +1,45 @@
+#include "../include/SparseCheckout.h"
+#include "../include/Utils.h"
+#include <cstdio>
+#include <sstream>
+
+const char* const SparseCheckout::FILE_PATH = ".gitlite/info/sparse-checkout";
+
+SparseCheckout SparseCheckout::load() {
+    std::vector<std::string> patterns;
+    if (Utils::isFile(FILE_PATH)) {
+        std::istringstream lines(Utils::readContentsAsString(FILE_PATH));
+        std::string line;
+        while (std::getline(lines, line)) {
+            if (!line.empty()) {
+                patterns.push_back(line);
+            }
+        }
+    }
+    return fromPatterns(patterns);
+}
+
+SparseCheckout SparseCheckout::fromPatterns(const std::vector<std::string>& patterns) {
+    SparseCheckout sparse;
+    std::string text;
+    for (const auto& pattern : patterns) {
+        text += pattern + "\n";
+    }
+    sparse.isEnabled = !patterns.empty();
+    sparse.lines = patterns;
+    sparse.rules = IgnoreRules::parse(text);
+    return sparse;
+}
+
+void SparseCheckout::save(const std::vector<std::string>& patterns) {
+    if (patterns.empty()) {
+        std::remove(FILE_PATH);
+        return;
+    }
+    std::string text;
+    for (const auto& pattern : patterns) {
+        text += pattern + "\n";
+    }
+    Utils::createDirectories(".gitlite/info");
+    Utils::writeContents(FILE_PATH, text);
+}
@@ -0,0 +1,139 @@
+#include "../include/TarWriter.h"
+#include <cstdio>
+#include <cstring>
+
+const size_t TarWriter::BLOCK_SIZE;
+const size_t TarWriter::RECORD_SIZE;
+
+namespace {
+const size_t NAME_SIZE = 100;
+const size_t PREFIX_SIZE = 155;
+
+/** Writes VALUE in octal into the DIGITS-byte field FIELD, NUL-terminated.
+ *  Returns false, leaving the field zero, if VALUE needs more digits. */
+bool putOctal(char* field, size_t digits, uint64_t value) {
+    field[digits - 1] = '\0';
+    for (size_t i = digits - 1; i > 0; --i) {
+        field[i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    if (value != 0) {
+        std::memset(field, '0', digits - 1);
+        return false;
+    }
+    return true;
+}
+
+/** Returns the pax record "<length> KEY=VALUE\n", whose length counts its
+ *  own digits. */
+std::string paxRecord(const std::string& key, const std::string& value) {
+    std::string record = " " + key + "=" + value + "\n";
+    size_t length = record.size() + 1;
+    while (std::to_string(length).size() + record.size() != length) {
+        ++length;
+    }
+    return std::to_string(length) + record;
+}
+
+/** Splits NAME into a ustar PREFIX and name at a "/"; false if it cannot fit. */
+bool splitName(const std::string& name, std::string& prefix, std::string& base) {
+    if (name.size() <= NAME_SIZE) {
+        prefix.clear();
+        base = name;
+        return true;
+    }
+    for (size_t slash = name.find('/'); slash != std::string::npos; slash = name.find('/', slash + 1)) {
+        if (slash <= PREFIX_SIZE && name.size() - slash - 1 <= NAME_SIZE && slash + 1 < name.size()) {
+            prefix = name.substr(0, slash);
+            base = name.substr(slash + 1);
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+void TarWriter::writeHeader(const std::string& name, uint64_t size, std::time_t mtime, char type) {
+    char header[BLOCK_SIZE] = {};
+    std::string prefix, base;
+    if (!splitName(name, prefix, base)) {
+        base = name.substr(0, NAME_SIZE); // only for pax headers, which precede the real one
+    }
+    std::memcpy(header, base.data(), base.size());
+    putOctal(header + 100, 8, 0644);
+    putOctal(header + 108, 8, 0);
+    putOctal(header + 116, 8, 0);
+    putOctal(header + 124, 12, size);
+    if (!putOctal(header + 136, 12, static_cast<uint64_t>(mtime < 0 ? 0 : mtime))) {
+        putOctal(header + 136, 12, 077777777777ULL); // past the year 2242
+    }
+    header[156] = type;
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+    std::memcpy(header + 345, prefix.data(), prefix.size());
+
+    // The checksum is taken with its own field as spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (unsigned char c : header) {
+        checksum += c;
+    }
+    std::snprintf(header + 148, 8, "%06o", checksum);
+    header[155] = ' ';
+
+    out.write(header, BLOCK_SIZE);
+    written += BLOCK_SIZE;
+}
+
+void TarWriter::writePadded(const std::string& data) {
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    size_t padding = (BLOCK_SIZE - data.size() % BLOCK_SIZE) % BLOCK_SIZE;
+    static const char zeros[BLOCK_SIZE] = {};
+    out.write(zeros, static_cast<std::streamsize>(padding));
+    written += data.size() + padding;
+}
+
+void TarWriter::addFile(const std::string& name, const std::string& content, std::time_t mtime) {
+    addFile(name, static_cast<uint64_t>(content.size()), mtime);
+    write(content.data(), content.size());
+}
+
+void TarWriter::addFile(const std::string& name, uint64_t size, std::time_t mtime) {
+    std::string records;
+    std::string prefix, base;
+    if (!splitName(name, prefix, base)) {
+        records += paxRecord("path", name);
+    }
+    char field[12];
+    if (!putOctal(field, sizeof(field), size)) {
+        records += paxRecord("size", std::to_string(size)); // the header's size field is left 0
+    }
+    if (!records.empty()) {
+        writeHeader("PaxHeader/" + name, records.size(), mtime, 'x');
+        writePadded(records);
+    }
+    writeHeader(name, size, mtime, '0');
+    remaining = size;
+}
+
+void TarWriter::write(const char* data, size_t size) {
+    out.write(data, static_cast<std::streamsize>(size));
+    written += size;
+    remaining -= size;
+    if (remaining == 0) {
+        size_t padding = (BLOCK_SIZE - written % BLOCK_SIZE) % BLOCK_SIZE;
+        static const char zeros[BLOCK_SIZE] = {};
+        out.write(zeros, static_cast<std::streamsize>(padding));
+        written += padding;
+    }
+}
+
+void TarWriter::finish() {
+    static const char zeros[RECORD_SIZE] = {};
+    uint64_t end = written + 2 * BLOCK_SIZE;
+    uint64_t total = (end + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+    out.write(zeros, 2 * BLOCK_SIZE);
+    out.write(zeros, static_cast<std::streamsize>(total - end));
+    written = total;
+    out.flush();
+}
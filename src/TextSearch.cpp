@@ -0,0 +1,179 @@
+#include "../include/TextSearch.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+const std::string SPECIAL = "\\^$.|?*+()[]{}";
+} // namespace
+
+TextSearch::TextSearch(const std::string& pattern)
+    : literal(extractLiteral(pattern, plain)), regex(pattern, std::regex::ECMAScript | std::regex::optimize) {}
+
+/** Returns the longest literal that every match of PATTERN contains.  Sets
+ *  PLAIN if PATTERN has no special characters at all.  Anything not
+ *  understood ends the current run, so the result is never too long. */
+std::string TextSearch::extractLiteral(const std::string& pattern, bool& plain) {
+    plain = pattern.find_first_of(SPECIAL) == std::string::npos;
+    if (plain) {
+        return pattern;
+    }
+    std::string best;
+    std::string run;
+    auto endRun = [&best, &run] {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '|') {
+            return ""; // either side may match alone
+        }
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char next = pattern[++i];
+            if (SPECIAL.find(next) != std::string::npos || next == '/' || next == '-') {
+                run += next;
+            } else {
+                endRun(); // a class such as \d, or an assertion such as \b
+                // Skip the operand of \xHH, \uHHHH, \cX and of \0 or a back
+                // reference, which must not be read as literal text
+                auto isOperand = [next](unsigned char following) {
+                    if (next == 'c') {
+                        return std::isalpha(following) != 0;
+                    }
+                    if (std::isdigit(static_cast<unsigned char>(next))) {
+                        return std::isdigit(following) != 0;
+                    }
+                    return std::isxdigit(following) != 0;
+                };
+                size_t operand = next == 'x' ? 2 : next == 'u' ? 4 : next == 'c' ? 1 : 0;
+                if (std::isdigit(static_cast<unsigned char>(next))) {
+                    operand = pattern.size();
+                }
+                for (; operand > 0 && i + 1 < pattern.size() &&
+                       isOperand(static_cast<unsigned char>(pattern[i + 1]));
+                     --operand) {
+                    ++i;
+                }
+            }
+        } else if (c == '[') {
+            endRun();
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') {
+                ++j;
+            }
+            if (j < pattern.size() && pattern[j] == ']') {
+                ++j;
+            }
+            for (; j < pattern.size() && pattern[j] != ']'; ++j) {
+                if (pattern[j] == '\\') {
+                    ++j;
+                }
+            }
+            i = j;
+        } else if (c == '(') {
+            // Groups may be optional, repeated or lookarounds: skip them
+            endRun();
+            int depth = 0;
+            for (; i < pattern.size(); ++i) {
+                if (pattern[i] == '\\') {
+                    ++i;
+                } else if (pattern[i] == '(') {
+                    ++depth;
+                } else if (pattern[i] == ')' && --depth == 0) {
+                    break;
+                }
+            }
+        } else if (c == '*' || c == '?' || c == '{') {
+            // The previous atom may occur zero times
+            if (!run.empty()) {
+                run.pop_back();
+            }
+            endRun();
+            if (c == '{') {
+                while (i < pattern.size() && pattern[i] != '}') {
+                    ++i;
+                }
+            }
+        } else if (c == '+') {
+            endRun(); // the previous atom occurs, but may repeat
+        } else if (SPECIAL.find(c) != std::string::npos) {
+            endRun();
+        } else {
+            run += c;
+        }
+    }
+    endRun();
+    return best;
+}
+
+const char* TextSearch::findLiteral(const char* begin, const char* end, std::string_view literal) {
+    size_t n = literal.size();
+    if (n == 0) {
+        return begin;
+    }
+    if (static_cast<size_t>(end - begin) < n) {
+        return end;
+    }
+    const char* p = begin;
+    const char* lastStart = end - n;
+#if defined(__SSE2__)
+    // Compare the first and last bytes of the literal at 16 start positions
+    // at once; only positions where both agree are compared in full
+    const __m128i first = _mm_set1_epi8(literal[0]);
+    const __m128i last = _mm_set1_epi8(literal[n - 1]);
+    for (; lastStart - p >= 15; p += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + n - 1));
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (std::memcmp(p + bit, literal.data(), n) == 0) {
+                return p + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; p <= lastStart; ++p) {
+        if (*p == literal[0] && std::memcmp(p, literal.data(), n) == 0) {
+            return p;
+        }
+    }
+    return end;
+}
+
+void TextSearch::search(std::string_view text, std::vector<std::pair<size_t, std::string_view>>& matches) const {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    const char* counted = begin; // line numbers are counted up to here
+    size_t lineNumber = 1;
+    const char* position = begin;
+    while (position < end) {
+        const char* hit = findLiteral(position, end, literal);
+        if (hit == end) {
+            break;
+        }
+        const char* lineStart = hit;
+        while (lineStart > position && lineStart[-1] != '\n') {
+            --lineStart;
+        }
+        const char* lineEnd = static_cast<const char*>(std::memchr(hit, '\n', static_cast<size_t>(end - hit)));
+        if (lineEnd == nullptr) {
+            lineEnd = end;
+        }
+        std::string_view line(lineStart, static_cast<size_t>(lineEnd - lineStart));
+        if (plain || std::regex_search(line.begin(), line.end(), regex)) {
+            lineNumber += static_cast<size_t>(std::count(counted, lineStart, '\n'));
+            counted = lineStart;
+            matches.emplace_back(lineNumber, line);
+        }
+        position = lineEnd + 1;
+    }
+}
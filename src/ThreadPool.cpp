@@ -0,0 +1,128 @@
+#include "../include/ThreadPool.h"
+
+namespace {
+/** The pool and deque index of the worker running on this thread, if any. */
+thread_local const ThreadPool* currentPool = nullptr;
+thread_local unsigned currentIndex = 0;
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads) : queued(0), pending(0), nextQueue(0), stopping(false) {
+    if (threads == 0) {
+        threads = defaultThreads();
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        queues.emplace_back(new TaskQueue);
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskReady.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+/** Returns the number of hardware threads, or 1 if that is unknown. */
+unsigned ThreadPool::defaultThreads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+unsigned ThreadPool::size() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    unsigned index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pending;
+        index = currentPool == this ? currentIndex : nextQueue++ % size();
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Counted only once it can be taken, so a woken worker finds it
+        std::lock_guard<std::mutex> lock(mutex);
+        ++queued;
+    }
+    taskReady.notify_one();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    allDone.wait(lock, [this] { return pending == 0; });
+    if (firstError) {
+        std::exception_ptr error = firstError;
+        firstError = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+bool ThreadPool::take(unsigned index, std::function<void()> &task) {
+    {
+        TaskQueue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (unsigned step = 1; step < size(); ++step) {
+        TaskQueue &victim = *queues[(index + step) % size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    currentPool = this;
+    currentIndex = index;
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskReady.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0) {
+                return;
+            }
+            // Claim one counted task; it is in some deque, or about to be
+            --queued;
+        }
+        while (!take(index, task)) {
+            std::this_thread::yield();
+        }
+
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!firstError) {
+                firstError = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --pending;
+            if (pending == 0) {
+                allDone.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#include "../include/Trace.h"
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+bool Trace::active = false;
+std::atomic<int64_t> Trace::counters[Trace::COUNTER_COUNT];
+
+namespace {
+const char* const COUNTER_NAMES[Trace::COUNTER_COUNT] = {
+    "objects_read", "objects_written", "bytes_read", "bytes_written",
+    "stat_calls", "cache_hits", "cache_misses", "lock_waits", "filter_skips"};
+
+int64_t nowMicros() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+} // namespace
+
+/** Owns the recorded events for the lifetime of the process; reads
+ *  GITLITE_TRACE on startup and writes the trace file on exit. */
+class TraceSession {
+public:
+    struct Event {
+        std::string name;
+        int64_t start;
+        int64_t duration;
+        int thread;
+    };
+
+    TraceSession() : startTime(nowMicros()) {
+        const char* path = std::getenv("GITLITE_TRACE");
+        if (path != nullptr && *path != '\0') {
+            outputPath = path;
+            Trace::active = true;
+        }
+    }
+
+    ~TraceSession() {
+        if (Trace::active) {
+            Trace::active = false;
+            write();
+        }
+    }
+
+    void record(const char* name, int64_t start, int64_t duration) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto inserted = threadIds.emplace(std::this_thread::get_id(), static_cast<int>(threadIds.size()));
+        events.push_back({name, start - startTime, duration, inserted.first->second});
+    }
+
+private:
+    void write() {
+        std::ofstream out(outputPath);
+        if (!out.is_open()) {
+            return;
+        }
+        int pid = static_cast<int>(getpid());
+        int64_t endTime = nowMicros() - startTime;
+
+        out << "{\"traceEvents\":[\n";
+        for (const auto& event : events) {
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":" << event.start
+                << ",\"dur\":" << event.duration << ",\"pid\":" << pid << ",\"tid\":" << event.thread
+                << "},\n";
+        }
+        out << "{\"name\":\"counters\",\"ph\":\"C\",\"ts\":" << endTime << ",\"pid\":" << pid
+            << ",\"args\":{";
+        for (int i = 0; i < Trace::COUNTER_COUNT; ++i) {
+            out << (i ? "," : "") << "\"" << COUNTER_NAMES[i] << "\":" << Trace::counters[i].load();
+        }
+        out << "}}\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    int64_t startTime;
+    std::string outputPath;
+    std::mutex mutex;
+    std::vector<Event> events;
+    std::unordered_map<std::thread::id, int> threadIds;
+};
+
+namespace {
+TraceSession session;
+}
+
+void Trace::Region::begin(const char* eventName) {
+    name = eventName;
+    start = nowMicros();
+}
+
+void Trace::Region::end() {
+    session.record(name, start, nowMicros() - start);
+}
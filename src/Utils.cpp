@@ -1,8 +1,10 @@
 #include "../include/Utils.h"
+#include "../include/Trace.h"
 #include <cstdlib>
 #include <iostream>
 #include <sys/stat.h>
 #include <cstring>
+#include <utime.h>
 
 /** Assorted utilities.
  *
@@ -165,6 +167,19 @@ bool Utils::restrictedDelete(const std::string& filepath) {
     return false;
 }
 
+/** Adds BYTES to the BYTECOUNTER trace counter, and one to OBJECTCOUNTER
+ *  if FILEPATH lies in an object store. */
+static void countAccess(const std::string& filepath, Trace::Counter objectCounter,
+                        Trace::Counter byteCounter, size_t bytes) {
+    if (!Trace::enabled()) {
+        return;
+    }
+    Trace::count(byteCounter, static_cast<int64_t>(bytes));
+    if (filepath.find("objects/") != std::string::npos) {
+        Trace::count(objectCounter);
+    }
+}
+
  /* READING AND WRITING FILE CONTENTS */
 /** Return the entire contents of FILE as a byte array.  FILE must
  *  be a normal file.  Throws IllegalArgumentException
@@ -185,7 +200,8 @@ std::vector<unsigned char> Utils::readContents(const std::string& filepath) {
     
     std::vector<unsigned char> contents(size);
     file.read(reinterpret_cast<char*>(contents.data()), size);
-    
+
+    countAccess(filepath, Trace::OBJECTS_READ, Trace::BYTES_READ, size);
     return contents;
 }
 
@@ -215,6 +231,7 @@ void Utils::writeContents(const std::string& filepath, const std::string& conten
     }
     
     file.write(content.c_str(), content.size());
+    countAccess(filepath, Trace::OBJECTS_WRITTEN, Trace::BYTES_WRITTEN, content.size());
 }
 
 void Utils::writeContents(const std::string& filepath, const std::vector<unsigned char>& content) {
@@ -231,11 +248,29 @@ void Utils::writeContents(const std::string& filepath, const std::vector<unsigne
     }
     
     file.write(reinterpret_cast<const char*>(content.data()), content.size());
+    countAccess(filepath, Trace::OBJECTS_WRITTEN, Trace::BYTES_WRITTEN, content.size());
 }
 
 /** Returns a list of the names of all plain files in the directory DIR, in
 *  order as C++ Strings.  Returns null if DIR does
 *  not denote a directory. */
+/** Returns the type (DT_REG, DT_DIR, ...) of ENTRY, read from directory
+ *  DIRPATH.  Some filesystems (XFS without ftype, some NFS and overlay
+ *  setups) report DT_UNKNOWN; then the entry is lstat'ed. */
+static unsigned char entryType(const std::string& dirPath, const struct dirent* entry) {
+    if (entry->d_type != DT_UNKNOWN) {
+        return entry->d_type;
+    }
+    struct stat info;
+    if (lstat(Utils::join(dirPath, entry->d_name).c_str(), &info) != 0) {
+        return DT_UNKNOWN;
+    }
+    if (S_ISREG(info.st_mode)) {
+        return DT_REG;
+    }
+    return S_ISDIR(info.st_mode) ? DT_DIR : DT_UNKNOWN;
+}
+
 std::vector<std::string> Utils::plainFilenamesIn(const std::string& dirPath) {
     std::vector<std::string> files;
     
@@ -246,7 +281,7 @@ std::vector<std::string> Utils::plainFilenamesIn(const std::string& dirPath) {
     
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_type == DT_REG) { // Regular file
+        if (entryType(dirPath, entry) == DT_REG) { // Regular file
             files.push_back(std::string(entry->d_name));
         }
     }
@@ -256,6 +291,42 @@ std::vector<std::string> Utils::plainFilenamesIn(const std::string& dirPath) {
     return files;
 }
 
+/** Returns the paths, relative to DIR and in sorted order, of all plain
+ *  files in DIR and its subdirectories.  Returns an empty list if DIR does
+ *  not denote a directory. */
+std::vector<std::string> Utils::plainFilenamesUnder(const std::string& dirPath) {
+    std::vector<std::string> files;
+    std::vector<std::string> pending = {""};
+
+    while (!pending.empty()) {
+        std::string relDir = pending.back();
+        pending.pop_back();
+
+        DIR* dir = opendir(join(dirPath, relDir).c_str());
+        if (dir == nullptr) {
+            continue;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..") {
+                continue;
+            }
+            unsigned char type = entryType(join(dirPath, relDir), entry);
+            if (type == DT_REG) {
+                files.push_back(join(relDir, name));
+            } else if (type == DT_DIR) {
+                pending.push_back(join(relDir, name));
+            }
+        }
+        closedir(dir);
+    }
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
 /* OTHER FILE UTILITIES */
 
 /** Return the concatenation of FIRST and SECOND into a File path,
@@ -292,12 +363,14 @@ void Utils::exitWithMessage(const std::string& msg) {
 
 /** Returns true if PATH exists as a file or directory. */
 bool Utils::exists(const std::string& path) {
+    Trace::count(Trace::STAT_CALLS);
     struct stat buffer;
     return (stat(path.c_str(), &buffer) == 0);
 }
 
 /** Returns true if PATH exists and is a regular file. */
 bool Utils::isFile(const std::string& path) {
+    Trace::count(Trace::STAT_CALLS);
     struct stat buffer;
     if (stat(path.c_str(), &buffer) != 0) {
         return false;
@@ -307,6 +380,7 @@ bool Utils::isFile(const std::string& path) {
 
 /** Returns true if PATH exists and is a directory. */
 bool Utils::isDirectory(const std::string& path) {
+    Trace::count(Trace::STAT_CALLS);
     struct stat buffer;
     if (stat(path.c_str(), &buffer) != 0) {
         return false;
@@ -314,6 +388,21 @@ bool Utils::isDirectory(const std::string& path) {
     return S_ISDIR(buffer.st_mode);
 }
 
+/** Returns true if PATH is a directory with no entries. */
+bool Utils::isEmptyDirectory(const std::string& path) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return false;
+    }
+    bool empty = true;
+    struct dirent* entry;
+    while (empty && (entry = readdir(dir)) != nullptr) {
+        empty = std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0;
+    }
+    closedir(dir);
+    return empty;
+}
+
 /** Recursively creates all directories in PATH if they don't exist.
  *  Returns true if all directories were created or already exist,
  *  false otherwise. */
@@ -330,4 +419,9 @@ bool Utils::createDirectories(const std::string& path) {
     }
     
     return mkdir(path.c_str(), 0755) == 0 || isDirectory(path);
-}
\ No newline at end of file
+}
+
+/** Sets the modification time of PATH to now.  Returns true on success. */
+bool Utils::touch(const std::string& path) {
+    return utime(path.c_str(), nullptr) == 0;
+}
@@ -0,0 +1,87 @@
+#include "../include/Worktree.h"
+#include "../include/GitliteException.h"
+#include "../include/RefStore.h"
+#include "../include/Utils.h"
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+namespace {
+const std::string COMMONDIR = "commondir";
+const std::string WORKTREES = "worktrees";
+
+/** Returns the absolute path of existing PATH, symlinks resolved, or "". */
+std::string absolutePath(const std::string& path) {
+    char buffer[PATH_MAX];
+    return realpath(path.c_str(), buffer) != nullptr ? std::string(buffer) : "";
+}
+
+/** Whether PATH is the top directory of a linked worktree. */
+bool isLinkedWorktree(const std::string& path) {
+    return Utils::isFile(path + "/.gitlite/" + COMMONDIR);
+}
+} // namespace
+
+std::string Worktree::commonDir(const std::string& gitliteDir) {
+    std::ifstream file(gitliteDir + "/" + COMMONDIR);
+    std::string dir;
+    if (std::getline(file, dir) && !dir.empty()) {
+        return dir;
+    }
+    return gitliteDir;
+}
+
+std::string Worktree::lockPath() {
+    return commonDir() + "/" + WORKTREES;
+}
+
+std::vector<Worktree> Worktree::list() {
+    std::string common = commonDir();
+    std::vector<Worktree> trees;
+    trees.push_back({absolutePath(common + "/.."), RefStore(common).currentBranch()});
+    std::string registry = common + "/" + WORKTREES;
+    for (const auto& name : Utils::plainFilenamesIn(registry)) {
+        std::string path = Utils::readContentsAsString(registry + "/" + name);
+        if (isLinkedWorktree(path)) {
+            trees.push_back({path, RefStore(path + "/.gitlite").currentBranch()});
+        }
+    }
+    return trees;
+}
+
+std::string Worktree::checkedOutElsewhere(const std::string& branch) {
+    std::string here = absolutePath(".");
+    for (const auto& tree : list()) {
+        if (tree.branch == branch && tree.path != here) {
+            return tree.path;
+        }
+    }
+    return "";
+}
+
+void Worktree::create(const std::string& dir, const std::string& branch) {
+    std::string common = absolutePath(commonDir());
+    std::string top = absolutePath(dir);
+    std::string gitliteDir = top + "/.gitlite";
+    Utils::createDirectories(gitliteDir);
+    Utils::createDirectories(common + "/remotes");
+    Utils::writeContents(gitliteDir + "/" + COMMONDIR, common + "\n");
+    if (symlink((common + "/objects").c_str(), (gitliteDir + "/objects").c_str()) != 0 ||
+        symlink((common + "/remotes").c_str(), (gitliteDir + "/remotes").c_str()) != 0) {
+        throw GitliteException("Cannot create worktree in " + dir + ".");
+    }
+    RefStore(gitliteDir).write("HEAD", "ref: " + RefStore::branchRef(branch));
+
+    // Register under the directory's name, unless a live worktree has it
+    std::string registry = common + "/" + WORKTREES;
+    std::string base = top.substr(top.find_last_of('/') + 1);
+    std::string name = base;
+    for (int n = 1; Utils::isFile(registry + "/" + name) &&
+                    isLinkedWorktree(Utils::readContentsAsString(registry + "/" + name));
+         ++n) {
+        name = base + std::to_string(n);
+    }
+    Utils::createDirectories(registry);
+    Utils::writeContents(registry + "/" + name, top);
+}
@@ -0,0 +1,246 @@
+"""
+Synthetic Gitlite repository generator.
+
+Writes a repository directly in the on-disk format used by gitlite (objects
+named by gitlite's SHA-1 of their contents, commits as "parent/timestamp/message/
+files" text, refs under .gitlite/refs/heads), without running gitlite once per
+commit, so that repositories with very deep histories can be built quickly.
+
+History shape:
+- master receives commits in a first-parent chain;
+- BRANCHES topic branches fork off master at evenly spaced points, receive
+  their share of the commits, and are merged back into master every
+  MERGE_EVERY branch commits (two-parent merge commits);
+- every commit rewrites CHURN * FILES randomly chosen files (at least one).
+
+The working tree is left checked out at master with a clean staging area.
+"""
+
+import hashlib
+import os
+import random
+import sys
+from argparse import ArgumentParser
+
+
+def _rotl(x, n):
+    return ((x << n) | (x >> (32 - n))) & 0xFFFFFFFF
+
+
+def _sha1_blocks(message):
+    """SHA-1 compression over MESSAGE, already padded; returns the hex digest."""
+    h = [0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0]
+    for start in range(0, len(message), 64):
+        w = list(int.from_bytes(message[start + 4 * i:start + 4 * i + 4], "big")
+                 for i in range(16))
+        for t in range(16, 80):
+            w.append(_rotl(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16], 1))
+        a, b, c, d, e = h
+        for t in range(80):
+            if t < 20:
+                f, k = (b & c) | (~b & d), 0x5A827999
+            elif t < 40:
+                f, k = b ^ c ^ d, 0x6ED9EBA1
+            elif t < 60:
+                f, k = (b & c) | (b & d) | (c & d), 0x8F1BBCDC
+            else:
+                f, k = b ^ c ^ d, 0xCA62C1D6
+            a, b, c, d, e = ((_rotl(a, 5) + f + e + k + w[t]) & 0xFFFFFFFF,
+                             a, _rotl(b, 30), c, d)
+        h = [(x + y) & 0xFFFFFFFF for x, y in zip(h, (a, b, c, d, e))]
+    return "".join("{:08x}".format(x) for x in h)
+
+
+def gitlite_sha1(data):
+    """The object ID gitlite gives DATA (SHA1::SHA in src/Utils.cpp).
+
+    That implementation pads to (length + 8) rounded up to 64 bytes, so when
+    the length is 56 mod 64 the 0x80 marker is overwritten by the length
+    field, and it keeps the bit length in a 32-bit int.  Both only matter for
+    those lengths and for inputs of 256 MiB or more; everything else is plain
+    SHA-1, computed with hashlib."""
+    length = len(data)
+    if length % 64 != 56 and length < 1 << 28:
+        return hashlib.sha1(data).hexdigest()
+    padded_length = (length + 8 + 63) // 64 * 64
+    padded = bytearray(data) + bytes(padded_length - length)
+    padded[length] = 0x80
+    # int bitLength = length * 8, then "% 256" and "/= 256" as C does them
+    bits = (length * 8) & 0xFFFFFFFF
+    if bits >= 1 << 31:
+        bits -= 1 << 32
+    for i in range(padded_length - 1, padded_length - 9, -1):
+        quotient = abs(bits) // 256 * (-1 if bits < 0 else 1)
+        padded[i] = (bits - quotient * 256) & 0xFF
+        bits = quotient
+    return _sha1_blocks(bytes(padded))
+
+
+class Generator:
+    def __init__(self, out, files, commits, branches, merge_every, churn,
+                 sizes, seed):
+        self.out = out
+        self.gitlite = os.path.join(out, ".gitlite")
+        self.objects = os.path.join(self.gitlite, "objects")
+        self.num_files = files
+        self.num_commits = commits
+        self.num_branches = branches
+        self.merge_every = merge_every
+        self.churn = churn
+        self.sizes = sizes
+        self.rng = random.Random(seed)
+        self.timestamp = 1700000000
+        self.names = ["f{:07d}.txt".format(i) for i in range(files)]
+        self.written = 0
+
+    # -- object store --------------------------------------------------------
+
+    def write_object(self, data):
+        oid = gitlite_sha1(data)
+        path = os.path.join(self.objects, oid)
+        if not os.path.exists(path):
+            with open(path, "wb") as f:
+                f.write(data)
+            self.written += 1
+        return oid
+
+    def write_commit(self, parents, message, manifest):
+        self.timestamp += 60
+        files = "".join("{}:{};".format(name, manifest[name])
+                        for name in sorted(manifest))
+        text = "parent {}\ntimestamp {}\nmessage {}\nfiles {}\n".format(
+            " ".join(parents), self.timestamp, message, files)
+        return self.write_object(text.encode())
+
+    def write_ref(self, branch, oid):
+        path = os.path.join(self.gitlite, "refs", "heads", branch)
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        with open(path, "w") as f:
+            f.write(oid)
+
+    # -- content -------------------------------------------------------------
+
+    def file_size(self):
+        kind, _, params = self.sizes.partition(":")
+        args = [float(x) for x in params.split(",")] if params else []
+        if kind == "fixed":
+            return int(args[0])
+        if kind == "uniform":
+            return self.rng.randint(int(args[0]), int(args[1]))
+        if kind == "lognormal":
+            return max(1, int(self.rng.lognormvariate(args[0], args[1])))
+        raise ValueError("unknown size distribution " + self.sizes)
+
+    def new_blob(self, name, version):
+        header = "{} version {}\n".format(name, version).encode()
+        size = max(0, self.file_size() - len(header))
+        return self.write_object(header + self.rng.randbytes(size))
+
+    def mutate(self, manifest, versions, tag):
+        count = max(1, int(round(self.churn * self.num_files)))
+        for name in self.rng.sample(self.names, min(count, self.num_files)):
+            versions[name] = versions.get(name, 0) + 1
+            manifest[name] = self.new_blob(name + tag, versions[name])
+
+    # -- history -------------------------------------------------------------
+
+    def run(self):
+        if os.path.exists(self.gitlite):
+            sys.exit("{} already contains a repository".format(self.out))
+        os.makedirs(self.objects)
+        os.makedirs(os.path.join(self.gitlite, "refs", "heads"))
+        os.makedirs(os.path.join(self.gitlite, "refs", "remotes"))
+
+        # Same initial commit as "gitlite init"
+        initial = "parent \ntimestamp 0\nmessage initial commit\nfiles \n"
+        master = self.write_object(initial.encode())
+
+        versions = {}
+        manifest = {}
+        for name in self.names:
+            versions[name] = 0
+            manifest[name] = self.new_blob(name, 0)
+        master = self.write_commit([master], "import", manifest)
+        master_files = dict(manifest)
+        remaining = max(0, self.num_commits - 2)
+
+        # Branches fork at evenly spaced points along master's history
+        fork_points = set()
+        if self.num_branches:
+            step = max(1, remaining // (self.num_branches + 1))
+            fork_points = {step * (i + 1) for i in range(self.num_branches)}
+
+        branches = {}  # name -> [tip, manifest, commits since merge]
+        for i in range(remaining):
+            if i in fork_points:
+                name = "branch-{}".format(len(branches))
+                branches[name] = [master, dict(master_files), 0]
+
+            active = list(branches) + ["master"]
+            target = active[self.rng.randrange(len(active))]
+            if target == "master":
+                self.mutate(master_files, versions, "")
+                master = self.write_commit([master], "commit {}".format(i),
+                                           master_files)
+                continue
+
+            tip, files, since_merge = branches[target]
+            self.mutate(files, versions, "@" + target)
+            tip = self.write_commit([tip], "commit {} on {}".format(i, target),
+                                    files)
+            since_merge += 1
+            if since_merge >= self.merge_every:
+                # Branch wins for the files it touched
+                merged = dict(master_files)
+                merged.update(files)
+                master = self.write_commit(
+                    [master, tip], "Merged {} into master.".format(target),
+                    merged)
+                master_files = merged
+                files = dict(merged)
+                since_merge = 0
+            branches[target] = [tip, files, since_merge]
+
+        self.write_ref("master", master)
+        for name, (tip, _, _) in branches.items():
+            self.write_ref(name, tip)
+        with open(os.path.join(self.gitlite, "HEAD"), "w") as f:
+            f.write("ref: refs/heads/master")
+
+        # Check out master
+        for name, blob in master_files.items():
+            with open(os.path.join(self.objects, blob), "rb") as src, \
+                    open(os.path.join(self.out, name), "wb") as dst:
+                dst.write(src.read())
+        return master
+
+
+def main():
+    parser = ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("out", help="directory to create the repository in")
+    parser.add_argument("--files", type=int, default=1000,
+                        help="number of tracked files (default 1000)")
+    parser.add_argument("--commits", type=int, default=100,
+                        help="total number of commits (default 100)")
+    parser.add_argument("--branches", type=int, default=2,
+                        help="number of topic branches (default 2)")
+    parser.add_argument("--merge-every", type=int, default=10,
+                        help="branch commits between merges (default 10)")
+    parser.add_argument("--churn", type=float, default=0.01,
+                        help="fraction of files changed per commit "
+                             "(default 0.01)")
+    parser.add_argument("--sizes", default="lognormal:7,1.5",
+                        help="file size distribution: fixed:N, uniform:A,B "
+                             "or lognormal:MU,SIGMA (default lognormal:7,1.5)")
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    gen = Generator(args.out, args.files, args.commits, args.branches,
+                    args.merge_every, args.churn, args.sizes, args.seed)
+    head = gen.run()
+    print("{}: {} objects, master at {}".format(args.out, gen.written, head))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+"""
+End-to-end scale benchmarks for gitlite.
+
+For each repository size in --sizes, builds a synthetic repository with
+genrepo.py and times add, commit, status, log, checkout, merge, push and fetch
+on it.  For every command the driver records wall time, peak RSS, block I/O,
+page faults and context switches (from wait4), and with --syscalls the number
+of system calls (from strace -c, if installed).  It then prints one table per
+command with the scaling exponent between successive sizes (1.0 = linear in
+the size parameter) and optionally writes everything as JSON.
+
+Example:
+    python3 scalebench.py --sizes=files=100,1000,10000 --commits=200
+    python3 scalebench.py --sizes=commits=100,1000,10000 --files=100
+"""
+
+import json
+import math
+import os
+import re
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from argparse import ArgumentParser
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_GITLITE = os.path.join(HERE, "..", "..", "build", "gitlite")
+
+
+def run(gitlite, cwd, args, syscalls=False):
+    """Runs gitlite ARGS in CWD and returns a dict of measurements."""
+    cmd = [gitlite] + args
+    trace_file = None
+    if syscalls:
+        trace_file = tempfile.NamedTemporaryFile(suffix=".strace", delete=False)
+        trace_file.close()
+        cmd = ["strace", "-f", "-c", "-o", trace_file.name] + cmd
+
+    start = time.perf_counter()
+    proc = subprocess.Popen(cmd, cwd=cwd, stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    _, status, usage = os.wait4(proc.pid, 0)
+    wall = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+
+    result = {
+        "wall_s": wall,
+        "max_rss_kb": usage.ru_maxrss,
+        "user_s": usage.ru_utime,
+        "sys_s": usage.ru_stime,
+        "blocks_in": usage.ru_inblock,
+        "blocks_out": usage.ru_oublock,
+        "minor_faults": usage.ru_minflt,
+        "major_faults": usage.ru_majflt,
+        "ctx_switches": usage.ru_nvcsw + usage.ru_nivcsw,
+        "exit": proc.returncode,
+    }
+    if trace_file:
+        with open(trace_file.name) as f:
+            total = re.search(r"^\s*100\.00\s+\S+\s+\S+\s+(\d+)", f.read(), re.M)
+        os.unlink(trace_file.name)
+        if total:
+            result["syscalls"] = int(total.group(1))
+    return result
+
+
+def generate(path, params):
+    cmd = [sys.executable, os.path.join(HERE, "genrepo.py"), path]
+    for key, value in params.items():
+        cmd += ["--" + key.replace("_", "-"), str(value)]
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+
+
+def measure_repo(gitlite, workdir, params, syscalls):
+    """Builds one repository and returns {command: measurements}."""
+    repo = os.path.join(workdir, "repo")
+    remote = os.path.join(workdir, "remote")
+    generate(repo, params)
+    check = subprocess.run([gitlite, "fsck"], cwd=repo, stdout=subprocess.PIPE,
+                           stderr=subprocess.STDOUT, universal_newlines=True)
+    if check.returncode != 0 or check.stdout:
+        sys.exit("generated repository fails fsck:\n" + check.stdout)
+    shutil.copytree(repo, remote, symlinks=True)
+
+    def timed(args):
+        return run(gitlite, repo, args, syscalls)
+
+    results = {}
+    results["status"] = timed(["status"])
+    results["log"] = timed(["log"])
+
+    names = sorted(f for f in os.listdir(repo) if f.endswith(".txt"))
+    with open(os.path.join(repo, names[0]), "ab") as f:
+        f.write(b"scalebench edit\n")
+    results["add"] = timed(["add", names[0]])
+    results["commit"] = timed(["commit", "scalebench edit"])
+
+    branches = sorted(os.listdir(os.path.join(repo, ".gitlite", "refs", "heads")))
+    other = next((b for b in branches if b != "master"), None)
+    if other:
+        results["checkout"] = timed(["checkout", other])
+        run(gitlite, repo, ["checkout", "master"])
+        results["merge"] = timed(["merge", other])
+
+    run(gitlite, repo, ["add-remote", "origin", os.path.join(remote, ".gitlite")])
+    results["push"] = timed(["push", "origin", "master"])
+
+    # Give the remote a new commit so fetch has something to copy back
+    with open(os.path.join(remote, names[-1]), "ab") as f:
+        f.write(b"remote edit\n")
+    run(gitlite, remote, ["add", names[-1]])
+    run(gitlite, remote, ["commit", "remote edit"])
+    results["fetch"] = timed(["fetch", "origin", "master"])
+    return results
+
+
+def parse_sizes(spec):
+    key, _, values = spec.partition("=")
+    if not values:
+        raise ValueError("--sizes must look like files=100,1000")
+    return key.replace("-", "_"), [int(v) for v in values.split(",")]
+
+
+def print_report(key, points):
+    commands = []
+    for _, results in points:
+        commands += [c for c in results if c not in commands]
+    for command in commands:
+        print("\n== {} ==".format(command))
+        print("{:>10} {:>10} {:>10} {:>10} {:>10} {:>8}".format(
+            key, "wall(s)", "rss(MB)", "blk_in", "blk_out", "slope"))
+        previous = None
+        for size, results in points:
+            r = results.get(command)
+            if r is None:
+                continue
+            slope = ""
+            if previous and previous[1] > 0 and r["wall_s"] > 0 and size != previous[0]:
+                slope = "{:.2f}".format(math.log(r["wall_s"] / previous[1]) /
+                                        math.log(size / previous[0]))
+            print("{:>10} {:>10.3f} {:>10.1f} {:>10} {:>10} {:>8}".format(
+                size, r["wall_s"], r["max_rss_kb"] / 1024.0, r["blocks_in"],
+                r["blocks_out"], slope))
+            previous = (size, r["wall_s"])
+
+
+def main():
+    parser = ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--gitlite", default=DEFAULT_GITLITE,
+                        help="gitlite executable (default build/gitlite)")
+    parser.add_argument("--sizes", default="files=100,1000,10000",
+                        help="parameter to vary and its values, e.g. "
+                             "commits=100,1000 (default files=100,1000,10000)")
+    parser.add_argument("--files", type=int, default=1000)
+    parser.add_argument("--commits", type=int, default=100)
+    parser.add_argument("--branches", type=int, default=2)
+    parser.add_argument("--merge-every", type=int, default=10)
+    parser.add_argument("--churn", type=float, default=0.01)
+    parser.add_argument("--sizes-dist", dest="dist", default="lognormal:7,1.5",
+                        help="file size distribution passed to genrepo.py")
+    parser.add_argument("--syscalls", action="store_true",
+                        help="count system calls with strace -c")
+    parser.add_argument("--json", help="also write results to this file")
+    parser.add_argument("--keep", action="store_true",
+                        help="keep the generated repositories")
+    args = parser.parse_args()
+
+    gitlite = os.path.abspath(args.gitlite)
+    if not os.access(gitlite, os.X_OK):
+        sys.exit("gitlite executable not found at " + gitlite)
+    if args.syscalls and shutil.which("strace") is None:
+        sys.exit("--syscalls needs strace")
+
+    key, values = parse_sizes(args.sizes)
+    base = {"files": args.files, "commits": args.commits,
+            "branches": args.branches, "merge_every": args.merge_every,
+            "churn": args.churn, "sizes": args.dist}
+    if key not in base:
+        sys.exit("cannot vary " + key)
+
+    points = []
+    for value in values:
+        params = dict(base, **{key: value})
+        workdir = tempfile.mkdtemp(prefix="gitlite-scale-")
+        print("building {}={} in {}".format(key, value, workdir), file=sys.stderr)
+        try:
+            points.append((value, measure_repo(gitlite, workdir, params,
+                                               args.syscalls)))
+        finally:
+            if not args.keep:
+                shutil.rmtree(workdir, ignore_errors=True)
+
+    print_report(key, points)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"vary": key, "base": base, "command": shlex.join(sys.argv),
+                       "points": [{key: v, "results": r} for v, r in points]},
+                      f, indent=2)
+
+
+if __name__ == "__main__":
+    main()